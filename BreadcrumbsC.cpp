@@ -0,0 +1,340 @@
+//
+// The C interface to the breadcrumbs library.
+//
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include "BreadcrumbsC.h"
+#include "breadcrumbs.h"
+#include "RasterView.h"
+#include "TiffOps.h"
+#include "LayerExpression.h"
+#include "SearchControl.h"
+
+using std::string;
+using std::vector;
+
+struct breadcrumbs_terrain
+{
+    long width;
+    long height;
+    vector<float> elevation;
+    vector<float> cost;
+};
+
+struct breadcrumbs_cancellation
+{
+    CancellationToken token;
+};
+
+struct breadcrumbs_route
+{
+    vector<vector<breadcrumbs_point>> legs;
+    breadcrumbs_route_stats stats;
+};
+
+// Nothing may be thrown across the C boundary, so each call keeps its last error here
+thread_local string lastError;
+
+// Runs a call, turning anything it throws into BREADCRUMBS_ERROR and the thread's last error
+template <typename Call>
+breadcrumbs_status guarded(Call call)
+{
+    lastError.clear();
+    try
+    {
+        return call();
+    }
+    catch(std::exception &e)
+    {
+        lastError = e.what();
+    }
+    catch(...)
+    {
+        lastError = "Unknown error";
+    }
+    return BREADCRUMBS_ERROR;
+}
+
+breadcrumbs_status failed(const string &error)
+{
+    lastError = error;
+    return BREADCRUMBS_ERROR;
+}
+
+/*
+ * The sizes of the structs as first released. A caller's struct_size may be anything
+ * from these up, and fields added since are only read or written when it holds them.
+ */
+const size_t weightsSizeV1 = offsetof(breadcrumbs_weights, heuristic_z) + sizeof(double);
+const size_t routeStatsSizeV1 = offsetof(breadcrumbs_route_stats, milliseconds) + sizeof(double);
+
+int breadcrumbs_api_version(void)
+{
+    return BREADCRUMBS_API_VERSION;
+}
+
+const char *breadcrumbs_last_error(void)
+{
+    return lastError.c_str();
+}
+
+breadcrumbs_terrain *breadcrumbs_terrain_open(const char *elevation_tiff)
+{
+    breadcrumbs_terrain *terrain = nullptr;
+    guarded([&]
+    {
+        if (!elevation_tiff)
+        {
+            return failed("No elevation TIFF given");
+        }
+        const auto matrix = readTIFF(elevation_tiff);
+        if (matrix.empty())
+        {
+            return failed(string("Failed to read TIFF ") + elevation_tiff);
+        }
+
+        const long width = rasterWidth(matrix);
+        const long height = rasterHeight(matrix);
+        auto opened = new breadcrumbs_terrain{width, height, vector<float>(width * height),
+                                              vector<float>(width * height, 0.0f)};
+        for (long y = 0; y < height; ++y)
+        {
+            std::copy(matrix[y].begin(), matrix[y].end(), opened->elevation.begin() + y * width);
+        }
+        terrain = opened;
+        return BREADCRUMBS_OK;
+    });
+    return terrain;
+}
+
+breadcrumbs_terrain *breadcrumbs_terrain_create(const float *elevation, long width, long height)
+{
+    breadcrumbs_terrain *terrain = nullptr;
+    guarded([&]
+    {
+        if (!elevation || width < 1 || height < 1)
+        {
+            return failed("The elevation must have at least one cell");
+        }
+        terrain = new breadcrumbs_terrain{width, height, vector<float>(elevation, elevation + width * height),
+                                          vector<float>(width * height, 0.0f)};
+        return BREADCRUMBS_OK;
+    });
+    return terrain;
+}
+
+void breadcrumbs_terrain_free(breadcrumbs_terrain *terrain)
+{
+    delete terrain;
+}
+
+long breadcrumbs_terrain_width(const breadcrumbs_terrain *terrain)
+{
+    return terrain ? terrain->width : 0;
+}
+
+long breadcrumbs_terrain_height(const breadcrumbs_terrain *terrain)
+{
+    return terrain ? terrain->height : 0;
+}
+
+breadcrumbs_status breadcrumbs_terrain_add_layer(breadcrumbs_terrain *terrain, const char *filename,
+                                                 float weight, const char *expression)
+{
+    return guarded([&]
+    {
+        if (!terrain || !filename)
+        {
+            return failed("A layer needs a terrain and a filename");
+        }
+        // Parsed even when the weight is 0, so a bad expression is always reported
+        const LayerExpression layer(expression ? expression : "value");
+        if (weight != 0)
+        {
+            accumulateLayer(filename, layer, weight, terrain->cost.data(), terrain->elevation.data(),
+                            terrain->width, terrain->height);
+        }
+        return BREADCRUMBS_OK;
+    });
+}
+
+breadcrumbs_status breadcrumbs_terrain_add_layer_cells(breadcrumbs_terrain *terrain, const float *cells,
+                                                       float weight, const char *expression)
+{
+    return guarded([&]
+    {
+        if (!terrain || !cells)
+        {
+            return failed("A layer needs a terrain and cells");
+        }
+        const LayerExpression layer(expression ? expression : "value");
+        if (weight != 0)
+        {
+            for (long y = 0; y < terrain->height; ++y)
+            {
+                const long row = y * terrain->width;
+                layer.accumulate(terrain->cost.data() + row, cells + row, terrain->elevation.data() + row,
+                                 terrain->width, weight);
+            }
+        }
+        return BREADCRUMBS_OK;
+    });
+}
+
+breadcrumbs_cancellation *breadcrumbs_cancellation_create(double timeout_milliseconds)
+{
+    return new breadcrumbs_cancellation{CancellationToken(CancellationToken::deadlineAfter(timeout_milliseconds))};
+}
+
+void breadcrumbs_cancel(breadcrumbs_cancellation *cancellation)
+{
+    if (cancellation)
+    {
+        cancellation->token.cancel();
+    }
+}
+
+void breadcrumbs_cancellation_free(breadcrumbs_cancellation *cancellation)
+{
+    delete cancellation;
+}
+
+breadcrumbs_status breadcrumbs_route_find(const breadcrumbs_terrain *terrain,
+                                          const breadcrumbs_point *points, size_t count,
+                                          const breadcrumbs_weights *weights,
+                                          const breadcrumbs_cancellation *cancellation,
+                                          breadcrumbs_route **route)
+{
+    if (route)
+    {
+        *route = nullptr;
+    }
+    return guarded([&]
+    {
+        if (!terrain || !points || !weights || !route)
+        {
+            return failed("A route needs a terrain, points, weights and somewhere to put it");
+        }
+        if (weights->struct_size < weightsSizeV1)
+        {
+            return failed("The weights' struct_size must be set to sizeof(breadcrumbs_weights)");
+        }
+        if (count < 2)
+        {
+            return failed("A route needs at least two points");
+        }
+
+        std::deque<MatrixPoint> controlPoints;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (points[i].x < 0 || points[i].y < 0 || points[i].x >= terrain->width || points[i].y >= terrain->height)
+            {
+                return failed("Point (" + std::to_string(points[i].x) + ", " + std::to_string(points[i].y)
+                              + ") is outside the terrain");
+            }
+            MatrixPoint point;
+            point.x = points[i].x;
+            point.y = points[i].y;
+            controlPoints.push_back(point);
+        }
+
+        Weights searchWeights = {};
+        searchWeights.unitsPerPixel = weights->units_per_pixel;
+        searchWeights.gradeBase = weights->grade_base;
+        searchWeights.gradeRadius = weights->grade_radius;
+        searchWeights.movementCostXY = weights->movement_cost_xy;
+        searchWeights.movementCostZ = weights->movement_cost_z;
+        searchWeights.heuristicXY = weights->heuristic_xy;
+        searchWeights.heuristicZ = weights->heuristic_z;
+
+        const RasterView elevation(terrain->elevation.data(), terrain->width, terrain->height);
+        const RasterView cost(terrain->cost.data(), terrain->width, terrain->height);
+
+        const auto start = std::chrono::steady_clock::now();
+        SearchStats stats;
+        const Route found = getShortestPath(elevation, cost, controlPoints, searchWeights, nullptr,
+                                            cancellation ? &cancellation->token : nullptr, &stats);
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        auto *result = new breadcrumbs_route();
+        for (const auto &leg : found)
+        {
+            auto &cells = result->legs.emplace_back();
+            cells.reserve(leg.size());
+            for (const auto &cell : leg)
+            {
+                cells.push_back({cell.x, cell.y});
+            }
+        }
+
+        result->stats.struct_size = sizeof(breadcrumbs_route_stats);
+        switch (stats.status)
+        {
+            case SearchStatus::Cancelled: result->stats.status = BREADCRUMBS_CANCELLED; break;
+            case SearchStatus::TimedOut: result->stats.status = BREADCRUMBS_TIMED_OUT; break;
+            default: result->stats.status = BREADCRUMBS_OK;
+        }
+        result->stats.cost = getRouteCost(elevation, cost, found, searchWeights);
+        result->stats.expanded = stats.expanded;
+        result->stats.legs = stats.legs;
+        result->stats.milliseconds = elapsed.count();
+
+        *route = result;
+        return result->stats.status;
+    });
+}
+
+void breadcrumbs_route_free(breadcrumbs_route *route)
+{
+    delete route;
+}
+
+size_t breadcrumbs_route_leg_count(const breadcrumbs_route *route)
+{
+    return route ? route->legs.size() : 0;
+}
+
+const breadcrumbs_point *breadcrumbs_route_leg(const breadcrumbs_route *route, size_t leg, size_t *cells)
+{
+    if (!route || leg >= route->legs.size())
+    {
+        if (cells)
+        {
+            *cells = 0;
+        }
+        return nullptr;
+    }
+    if (cells)
+    {
+        *cells = route->legs[leg].size();
+    }
+    return route->legs[leg].data();
+}
+
+breadcrumbs_status breadcrumbs_route_get_stats(const breadcrumbs_route *route, breadcrumbs_route_stats *stats)
+{
+    return guarded([&]
+    {
+        if (!route || !stats)
+        {
+            return failed("Stats need a route and somewhere to put them");
+        }
+        const size_t size = stats->struct_size;
+        if (size < routeStatsSizeV1)
+        {
+            return failed("The stats' struct_size must be set to sizeof(breadcrumbs_route_stats)");
+        }
+        // Copied after struct_size, which stays as the caller set it
+        const size_t first = offsetof(breadcrumbs_route_stats, status);
+        std::memcpy(reinterpret_cast<char *>(stats) + first, reinterpret_cast<const char *>(&route->stats) + first,
+                    std::min(size, sizeof(breadcrumbs_route_stats)) - first);
+        return BREADCRUMBS_OK;
+    });
+}
@@ -0,0 +1,143 @@
+/*
+ * BreadcrumbsC.h
+ * A C interface to the breadcrumbs library, for embedding the search in other programs
+ * and languages without spawning the executable or round-tripping through files.
+ */
+
+#ifndef BREADCRUMBS_BREADCRUMBSC_H
+#define BREADCRUMBS_BREADCRUMBSC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Raised whenever a declaration here changes incompatibly. Functions are only ever added,
+ * and structs only ever extended at the end. Each struct passed in or out starts with
+ * struct_size, which the caller sets to the sizeof the struct it was built with, so a
+ * library never reads or writes past the end of an older caller's struct.
+ */
+#define BREADCRUMBS_API_VERSION 1
+
+// The BREADCRUMBS_API_VERSION the library was built with, to check against the header
+int breadcrumbs_api_version(void);
+
+typedef enum
+{
+    BREADCRUMBS_OK = 0,
+    // See breadcrumbs_last_error for why
+    BREADCRUMBS_ERROR = 1,
+    BREADCRUMBS_CANCELLED = 2,
+    BREADCRUMBS_TIMED_OUT = 3
+} breadcrumbs_status;
+
+/*
+ * A description of the last error on the calling thread, valid until the
+ * thread's next call into the library. Empty if there was none.
+ */
+const char *breadcrumbs_last_error(void);
+
+typedef struct
+{
+    long x;
+    long y;
+} breadcrumbs_point;
+
+// The weights of params.json
+typedef struct
+{
+    // sizeof(breadcrumbs_weights)
+    size_t struct_size;
+    double units_per_pixel;
+    int grade_base;
+    int grade_radius;
+    double movement_cost_xy;
+    double movement_cost_z;
+    double heuristic_xy;
+    double heuristic_z;
+} breadcrumbs_weights;
+
+/*
+ * An elevation raster and the cost layers accumulated over it. Layers must all be added
+ * before routing; after that any number of threads may route over one terrain at once.
+ */
+typedef struct breadcrumbs_terrain breadcrumbs_terrain;
+
+// Reads the elevation from a tiled float TIFF. Returns null on failure.
+breadcrumbs_terrain *breadcrumbs_terrain_open(const char *elevation_tiff);
+
+// Copies width * height elevations, row by row. Returns null on failure.
+breadcrumbs_terrain *breadcrumbs_terrain_create(const float *elevation, long width, long height);
+
+void breadcrumbs_terrain_free(breadcrumbs_terrain *terrain);
+
+long breadcrumbs_terrain_width(const breadcrumbs_terrain *terrain);
+long breadcrumbs_terrain_height(const breadcrumbs_terrain *terrain);
+
+/*
+ * Adds a cost layer TIFF of the terrain's size, each cell turned into a cost by an
+ * expression as in the layers of params.json, or used as it is for a null expression,
+ * and multiplied by weight.
+ */
+breadcrumbs_status breadcrumbs_terrain_add_layer(breadcrumbs_terrain *terrain, const char *filename,
+                                                 float weight, const char *expression);
+
+// As breadcrumbs_terrain_add_layer, from width * height cells in memory, row by row
+breadcrumbs_status breadcrumbs_terrain_add_layer_cells(breadcrumbs_terrain *terrain, const float *cells,
+                                                       float weight, const char *expression);
+
+/*
+ * Stops the searches given it when cancelled from any thread, or once its timeout passes.
+ * Must outlive the searches using it.
+ */
+typedef struct breadcrumbs_cancellation breadcrumbs_cancellation;
+
+// A timeout of 0 or less never passes
+breadcrumbs_cancellation *breadcrumbs_cancellation_create(double timeout_milliseconds);
+void breadcrumbs_cancel(breadcrumbs_cancellation *cancellation);
+void breadcrumbs_cancellation_free(breadcrumbs_cancellation *cancellation);
+
+// A route found over a terrain, holding the cells of each leg it completed
+typedef struct breadcrumbs_route breadcrumbs_route;
+
+typedef struct
+{
+    // sizeof(breadcrumbs_route_stats)
+    size_t struct_size;
+    // BREADCRUMBS_OK, or why the search stopped early
+    breadcrumbs_status status;
+    // The total cost of the legs completed
+    double cost;
+    long expanded;
+    long legs;
+    double milliseconds;
+} breadcrumbs_route_stats;
+
+/*
+ * Routes through count points in turn. cancellation may be null. On BREADCRUMBS_OK,
+ * BREADCRUMBS_CANCELLED or BREADCRUMBS_TIMED_OUT, *route is set to a route holding the
+ * legs which were completed, which the caller frees; on BREADCRUMBS_ERROR it is null.
+ */
+breadcrumbs_status breadcrumbs_route_find(const breadcrumbs_terrain *terrain,
+                                          const breadcrumbs_point *points, size_t count,
+                                          const breadcrumbs_weights *weights,
+                                          const breadcrumbs_cancellation *cancellation,
+                                          breadcrumbs_route **route);
+
+void breadcrumbs_route_free(breadcrumbs_route *route);
+
+size_t breadcrumbs_route_leg_count(const breadcrumbs_route *route);
+
+// The cells of one leg from its start to its end, valid until the route is freed
+const breadcrumbs_point *breadcrumbs_route_leg(const breadcrumbs_route *route, size_t leg, size_t *cells);
+
+// Fills in as much of *stats as its struct_size holds
+breadcrumbs_status breadcrumbs_route_get_stats(const breadcrumbs_route *route, breadcrumbs_route_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //BREADCRUMBS_BREADCRUMBSC_H
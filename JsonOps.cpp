@@ -0,0 +1,133 @@
+//
+// Reading params.json, and writing search stats as JSON.
+//
+
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include "JsonOps.h"
+#include "TiffOps.h"
+#include "LayerExpression.h"
+#include "ThreadPool.h"
+
+using std::vector;
+using std::string;
+using std::ifstream;
+using std::deque;
+
+nlohmann::json readJSON(const string& filename)
+{
+    nlohmann::json root;
+    ifstream jsonFile(filename);
+    if (!jsonFile)
+    {
+        throw std::runtime_error("Error Reading Input from params.json");
+    }
+    jsonFile >> root;
+    return root;
+}
+
+Weights getWeights(const nlohmann::json &json)
+{
+    return {
+            json.at("unitsPerPixel").get<double>(),
+            json.at("grade").at("base").get<int>(),
+            json.at("grade").at("radius").get<int>(),
+            json.at("movementCost").at("xy").get<double>(),
+            json.at("movementCost").at("z").get<double>(),
+            json.at("heuristic").at("xy").get<double>(),
+            json.at("heuristic").at("z").get<double>()
+
+    };
+}
+
+Matrix getCostMatrix(const Matrix &elevationMatrix, const nlohmann::json &layersJson, ThreadPool &pool)
+{
+    const long width = rasterWidth(elevationMatrix);
+    const long height = rasterHeight(elevationMatrix);
+    Matrix costMatrix(height, vector<float>(width, 0));
+    for (const auto & layerInfo : layersJson)
+    {
+        const float layerWeight = layerInfo["weight"];
+        if (layerWeight == 0)
+        {
+            continue;
+        }
+
+        const LayerExpression expression(layerInfo.value("expression", "value"));
+        const string layerFilename = layerInfo["filename"];
+        bool read = streamTIFF(layerFilename, width, height,
+                               [&](long x, long y, long tileWidth, long tileLength, const float *cells, long stride)
+        {
+            pool.parallelFor(0, tileLength, [&](long firstRow, long lastRow)
+            {
+                for (long row = firstRow; row < lastRow; ++row)
+                {
+                    expression.accumulate(costMatrix[y + row].data() + x,
+                                          cells + row * stride,
+                                          elevationMatrix[y + row].data() + x,
+                                          tileWidth,
+                                          layerWeight);
+                }
+            });
+        });
+
+        if (!read)
+        {
+            throw std::runtime_error("Failed to read cost layer " + layerFilename);
+        }
+    }
+
+    return costMatrix;
+}
+
+deque<MatrixPoint> getControlPoints(const nlohmann::json &json)
+{
+    deque<MatrixPoint> points;
+    for (const auto & point : json)
+    {
+        MatrixPoint m = {point.at("x").get<int>(), point.at("y").get<int>()};
+        points.push_back(m);
+    }
+
+    return points;
+}
+
+// One leg's stats from an instrumented search, or their totals over a route
+nlohmann::json legStatsJson(const LegStats &leg)
+{
+    return {
+            {"expanded", leg.expanded},
+            {"pushes", leg.pushes},
+            {"stalePops", leg.stalePops},
+            {"peakOpen", leg.peakOpen},
+            {"bytesAllocated", leg.bytesAllocated},
+            {"milliseconds", leg.milliseconds},
+            {"stepCostMilliseconds", leg.stepCostMilliseconds},
+            {"queueMilliseconds", leg.queueMilliseconds}
+    };
+}
+
+nlohmann::json searchStatsJson(const SearchStats &stats)
+{
+    LegStats total;
+    auto legs = nlohmann::json::array();
+    for (const auto &leg : stats.legStats)
+    {
+        total.expanded += leg.expanded;
+        total.pushes += leg.pushes;
+        total.stalePops += leg.stalePops;
+        total.peakOpen = std::max(total.peakOpen, leg.peakOpen);
+        total.bytesAllocated = std::max(total.bytesAllocated, leg.bytesAllocated);
+        total.milliseconds += leg.milliseconds;
+        total.stepCostMilliseconds += leg.stepCostMilliseconds;
+        total.queueMilliseconds += leg.queueMilliseconds;
+        legs.push_back(legStatsJson(leg));
+    }
+
+    auto json = legStatsJson(total);
+    json["status"] = searchStatusName(stats.status);
+    json["legsComplete"] = stats.legs;
+    json["legs"] = legs;
+    return json;
+}
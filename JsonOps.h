@@ -0,0 +1,48 @@
+//
+// Reading params.json, and writing search stats as JSON.
+//
+
+#ifndef BREADCRUMBS_JSONOPS_H
+#define BREADCRUMBS_JSONOPS_H
+
+#include <string>
+#include <deque>
+#include "json.hpp"
+#include "breadcrumbs.h"
+#include "SearchControl.h"
+
+class ThreadPool;
+
+/*
+ * Reads a JSON file with the given name into a JSON object.
+ */
+nlohmann::json readJSON(const std::string& filename);
+
+/*
+ * Read the weights out of the JSON object and into a Weights object.
+ * Throws nlohmann::json::exception if a weight is missing.
+ */
+Weights getWeights(const nlohmann::json &json);
+
+/*
+ * Creates an accumulated cost matrix for all cost layers given in params.json.
+ * Each layer is streamed into the matrix through its expression with its weight applied,
+ * so only one full-size matrix is ever held in memory. Rows of each tile are split
+ * between the threads of the pool. Layers weighted zero are not read.
+ */
+Matrix getCostMatrix(const Matrix &elevationMatrix, const nlohmann::json &layersJson, ThreadPool &pool);
+
+/*
+ * Reads the points which the algorithm must pass through from
+ * the JSON object.
+ * Returns a deque of MatrixPoints.
+ */
+std::deque<MatrixPoint> getControlPoints(const nlohmann::json &json);
+
+/*
+ * The stats of an instrumented search: its status, totals over its legs, in which
+ * the peak open list and bytes are the largest of any leg, and the stats of each leg.
+ */
+nlohmann::json searchStatsJson(const SearchStats &stats);
+
+#endif //BREADCRUMBS_JSONOPS_H
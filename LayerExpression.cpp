@@ -0,0 +1,515 @@
+//
+// Per-layer cost expressions read from params.json.
+//
+
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+#include "LayerExpression.h"
+#include "TiffOps.h"
+
+using std::string;
+using std::vector;
+using std::unique_ptr;
+using std::make_unique;
+using Op = LayerExpression::Op;
+using Instruction = LayerExpression::Instruction;
+
+// Cells evaluated together by each operation in accumulate()
+const long blockSize = 256;
+
+// Deepest operand stack an expression may need
+const int maxStackDepth = 32;
+
+struct ExpressionNode
+{
+    Op op;
+    float constant = 0;
+    vector<unique_ptr<ExpressionNode>> operands;
+};
+
+struct FunctionInfo
+{
+    const char *name;
+    Op op;
+    size_t arity;
+};
+
+const FunctionInfo functions [] = {
+        {"min", Op::Min, 2},
+        {"max", Op::Max, 2},
+        {"clamp", Op::Clamp, 3},
+        {"abs", Op::Abs, 1},
+        {"sqrt", Op::Sqrt, 1},
+        {"exp", Op::Exp, 1},
+        {"log", Op::Log, 1},
+        {"pow", Op::Power, 2},
+        {"step", Op::Step, 2},
+        {"select", Op::Select, 3},
+};
+
+/*
+ * Applies one operation to scalar operands.
+ * Shared by constant folding and single-cell evaluation.
+ */
+float applyOp(Op op, const float *a)
+{
+    switch (op)
+    {
+        case Op::Add: return a[0] + a[1];
+        case Op::Subtract: return a[0] - a[1];
+        case Op::Multiply: return a[0] * a[1];
+        case Op::Divide: return a[0] / a[1];
+        case Op::Power: return std::pow(a[0], a[1]);
+        case Op::Negate: return -a[0];
+        case Op::Less: return a[0] < a[1];
+        case Op::LessEqual: return a[0] <= a[1];
+        case Op::Greater: return a[0] > a[1];
+        case Op::GreaterEqual: return a[0] >= a[1];
+        case Op::Equal: return a[0] == a[1];
+        case Op::NotEqual: return a[0] != a[1];
+        case Op::Min: return std::min(a[0], a[1]);
+        case Op::Max: return std::max(a[0], a[1]);
+        case Op::Clamp: return std::min(std::max(a[0], a[1]), a[2]);
+        case Op::Abs: return std::abs(a[0]);
+        case Op::Sqrt: return std::sqrt(a[0]);
+        case Op::Exp: return std::exp(a[0]);
+        case Op::Log: return std::log(a[0]);
+        case Op::Step: return a[0] >= a[1];
+        case Op::Select: return a[0] != 0 ? a[1] : a[2];
+        default: return 0;
+    }
+}
+
+/*
+ * Recursive descent parser for the expression grammar:
+ *   comparison := additive [('<' | '<=' | '>' | '>=' | '==' | '!=') additive]
+ *   additive   := multiplicative {('+' | '-') multiplicative}
+ *   multiplicative := unary {('*' | '/') unary}
+ *   unary      := '-' unary | power
+ *   power      := primary ['^' unary]
+ *   primary    := number | value | elevation | function '(' arguments ')' | '(' comparison ')'
+ */
+class ExpressionParser
+{
+public:
+    explicit ExpressionParser(const string &source) : source(source) {}
+
+    unique_ptr<ExpressionNode> parse()
+    {
+        auto root = comparison();
+        skipSpace();
+        if (position != source.size())
+        {
+            fail("unexpected '" + source.substr(position, 1) + "'");
+        }
+
+        return root;
+    }
+
+private:
+    void fail(const string &reason) const
+    {
+        throw std::runtime_error("Invalid layer expression \"" + source + "\": " + reason);
+    }
+
+    void skipSpace()
+    {
+        while (position < source.size() && std::isspace((unsigned char)source[position]))
+        {
+            ++position;
+        }
+    }
+
+    bool accept(const string &token)
+    {
+        skipSpace();
+        if (source.compare(position, token.size(), token) == 0)
+        {
+            position += token.size();
+            return true;
+        }
+
+        return false;
+    }
+
+    void expect(const string &token)
+    {
+        if (!accept(token))
+        {
+            fail("expected '" + token + "'");
+        }
+    }
+
+    static unique_ptr<ExpressionNode> makeNode(Op op, unique_ptr<ExpressionNode> a, unique_ptr<ExpressionNode> b = nullptr)
+    {
+        auto node = make_unique<ExpressionNode>();
+        node->op = op;
+        node->operands.push_back(std::move(a));
+        if (b)
+        {
+            node->operands.push_back(std::move(b));
+        }
+
+        return node;
+    }
+
+    unique_ptr<ExpressionNode> comparison()
+    {
+        auto left = additive();
+        // Two character operators are tried first so "<=" is not read as "<"
+        const std::pair<const char *, Op> comparisons [] = {
+                {"<=", Op::LessEqual}, {">=", Op::GreaterEqual}, {"==", Op::Equal}, {"!=", Op::NotEqual},
+                {"<", Op::Less}, {">", Op::Greater}
+        };
+        for (const auto &comparison : comparisons)
+        {
+            if (accept(comparison.first))
+            {
+                return makeNode(comparison.second, std::move(left), additive());
+            }
+        }
+
+        return left;
+    }
+
+    unique_ptr<ExpressionNode> additive()
+    {
+        auto left = multiplicative();
+        while (true)
+        {
+            if (accept("+"))
+            {
+                left = makeNode(Op::Add, std::move(left), multiplicative());
+            }
+            else if (accept("-"))
+            {
+                left = makeNode(Op::Subtract, std::move(left), multiplicative());
+            }
+            else
+            {
+                return left;
+            }
+        }
+    }
+
+    unique_ptr<ExpressionNode> multiplicative()
+    {
+        auto left = unary();
+        while (true)
+        {
+            if (accept("*"))
+            {
+                left = makeNode(Op::Multiply, std::move(left), unary());
+            }
+            else if (accept("/"))
+            {
+                left = makeNode(Op::Divide, std::move(left), unary());
+            }
+            else
+            {
+                return left;
+            }
+        }
+    }
+
+    unique_ptr<ExpressionNode> unary()
+    {
+        if (accept("-"))
+        {
+            return makeNode(Op::Negate, unary());
+        }
+
+        auto base = primary();
+        if (accept("^"))
+        {
+            return makeNode(Op::Power, std::move(base), unary());
+        }
+
+        return base;
+    }
+
+    unique_ptr<ExpressionNode> primary()
+    {
+        skipSpace();
+        if (position >= source.size())
+        {
+            fail("unexpected end");
+        }
+
+        if (accept("("))
+        {
+            auto inner = comparison();
+            expect(")");
+            return inner;
+        }
+
+        const char *start = source.c_str() + position;
+        if (std::isdigit((unsigned char)*start) || *start == '.')
+        {
+            char *end = nullptr;
+            auto node = make_unique<ExpressionNode>();
+            node->op = Op::Constant;
+            node->constant = std::strtof(start, &end);
+            position += end - start;
+            return node;
+        }
+
+        size_t nameEnd = position;
+        while (nameEnd < source.size() && (std::isalnum((unsigned char)source[nameEnd]) || source[nameEnd] == '_'))
+        {
+            ++nameEnd;
+        }
+        const string name = source.substr(position, nameEnd - position);
+        if (name.empty())
+        {
+            fail("unexpected '" + source.substr(position, 1) + "'");
+        }
+        position = nameEnd;
+
+        auto node = make_unique<ExpressionNode>();
+        if (name == "value")
+        {
+            node->op = Op::Value;
+            return node;
+        }
+        if (name == "elevation")
+        {
+            node->op = Op::Elevation;
+            return node;
+        }
+
+        for (const auto &function : functions)
+        {
+            if (name == function.name)
+            {
+                node->op = function.op;
+                expect("(");
+                for (size_t i = 0; i < function.arity; ++i)
+                {
+                    if (i > 0)
+                    {
+                        expect(",");
+                    }
+                    node->operands.push_back(comparison());
+                }
+                expect(")");
+                return node;
+            }
+        }
+
+        fail("unknown name '" + name + "'");
+        return nullptr;
+    }
+
+    const string &source;
+    size_t position = 0;
+};
+
+/*
+ * Replaces every operation whose operands are all constants with its result.
+ */
+void foldConstants(ExpressionNode &node)
+{
+    bool allConstant = !node.operands.empty();
+    float operands[3] = {};
+    for (size_t i = 0; i < node.operands.size(); ++i)
+    {
+        foldConstants(*node.operands[i]);
+        allConstant = allConstant && node.operands[i]->op == Op::Constant;
+        operands[i] = node.operands[i]->constant;
+    }
+
+    if (allConstant)
+    {
+        node.constant = applyOp(node.op, operands);
+        node.op = Op::Constant;
+        node.operands.clear();
+    }
+}
+
+// Emits the node in postfix order, returning the stack depth it needs
+int emit(const ExpressionNode &node, vector<Instruction> &program)
+{
+    int depth = 0;
+    for (size_t i = 0; i < node.operands.size(); ++i)
+    {
+        depth = std::max(depth, (int)i + emit(*node.operands[i], program));
+    }
+    program.push_back({node.op, node.constant});
+
+    return std::max(depth, 1);
+}
+
+LayerExpression::LayerExpression(const string &source)
+{
+    auto root = ExpressionParser(source).parse();
+    foldConstants(*root);
+    maxDepth = emit(*root, program);
+    if (maxDepth > maxStackDepth)
+    {
+        throw std::runtime_error("Invalid layer expression \"" + source + "\": nested too deeply");
+    }
+}
+
+bool LayerExpression::isIdentity() const
+{
+    return program.size() == 1 && program[0].op == Op::Value;
+}
+
+bool LayerExpression::usesElevation() const
+{
+    return std::any_of(program.begin(), program.end(),
+                       [](const Instruction &instruction) { return instruction.op == Op::Elevation; });
+}
+
+float LayerExpression::evaluate(float value, float elevation) const
+{
+    float stack[maxStackDepth];
+    int top = 0;
+    for (const auto &instruction : program)
+    {
+        switch (instruction.op)
+        {
+            case Op::Value: stack[top++] = value; break;
+            case Op::Elevation: stack[top++] = elevation; break;
+            case Op::Constant: stack[top++] = instruction.constant; break;
+            case Op::Negate: case Op::Abs: case Op::Sqrt: case Op::Exp: case Op::Log:
+                stack[top - 1] = applyOp(instruction.op, &stack[top - 1]);
+                break;
+            case Op::Clamp: case Op::Select:
+                top -= 2;
+                stack[top - 1] = applyOp(instruction.op, &stack[top - 1]);
+                break;
+            default:
+                top -= 1;
+                stack[top - 1] = applyOp(instruction.op, &stack[top - 1]);
+                break;
+        }
+    }
+
+    return stack[0];
+}
+
+/*
+ * Each operation is a separate loop over one block, written so the compiler can vectorize it.
+ * Stack slots point either at the caller's arrays or at that slot's own scratch block,
+ * so reading `value` or `elevation` costs no copy.
+ */
+void LayerExpression::accumulate(float *destination, const float *values, const float *elevation,
+                                 long count, float weight) const
+{
+    if (isIdentity())
+    {
+        for (long i = 0; i < count; ++i)
+        {
+            destination[i] += values[i] * weight;
+        }
+        return;
+    }
+
+    vector<float> scratch(maxDepth * blockSize);
+    const float *slots[maxStackDepth];
+
+    for (long blockStart = 0; blockStart < count; blockStart += blockSize)
+    {
+        const long n = std::min(blockSize, count - blockStart);
+        int top = 0;
+
+        for (const auto &instruction : program)
+        {
+            float *out;
+            const float *a = nullptr, *b = nullptr, *c = nullptr;
+            switch (instruction.op)
+            {
+                case Op::Value:
+                    slots[top++] = values + blockStart;
+                    continue;
+                case Op::Elevation:
+                    slots[top++] = elevation + blockStart;
+                    continue;
+                case Op::Constant:
+                    out = &scratch[top * blockSize];
+                    std::fill(out, out + n, instruction.constant);
+                    slots[top++] = out;
+                    continue;
+                case Op::Negate: case Op::Abs: case Op::Sqrt: case Op::Exp: case Op::Log:
+                    a = slots[top - 1];
+                    out = &scratch[(top - 1) * blockSize];
+                    break;
+                case Op::Clamp: case Op::Select:
+                    top -= 2;
+                    a = slots[top - 1];
+                    b = slots[top];
+                    c = slots[top + 1];
+                    out = &scratch[(top - 1) * blockSize];
+                    break;
+                default:
+                    top -= 1;
+                    a = slots[top - 1];
+                    b = slots[top];
+                    out = &scratch[(top - 1) * blockSize];
+                    break;
+            }
+
+            switch (instruction.op)
+            {
+                case Op::Add: for (long i = 0; i < n; ++i) out[i] = a[i] + b[i]; break;
+                case Op::Subtract: for (long i = 0; i < n; ++i) out[i] = a[i] - b[i]; break;
+                case Op::Multiply: for (long i = 0; i < n; ++i) out[i] = a[i] * b[i]; break;
+                case Op::Divide: for (long i = 0; i < n; ++i) out[i] = a[i] / b[i]; break;
+                case Op::Power: for (long i = 0; i < n; ++i) out[i] = std::pow(a[i], b[i]); break;
+                case Op::Negate: for (long i = 0; i < n; ++i) out[i] = -a[i]; break;
+                case Op::Less: for (long i = 0; i < n; ++i) out[i] = a[i] < b[i] ? 1.0f : 0.0f; break;
+                case Op::LessEqual: for (long i = 0; i < n; ++i) out[i] = a[i] <= b[i] ? 1.0f : 0.0f; break;
+                case Op::Greater: for (long i = 0; i < n; ++i) out[i] = a[i] > b[i] ? 1.0f : 0.0f; break;
+                case Op::GreaterEqual: for (long i = 0; i < n; ++i) out[i] = a[i] >= b[i] ? 1.0f : 0.0f; break;
+                case Op::Equal: for (long i = 0; i < n; ++i) out[i] = a[i] == b[i] ? 1.0f : 0.0f; break;
+                case Op::NotEqual: for (long i = 0; i < n; ++i) out[i] = a[i] != b[i] ? 1.0f : 0.0f; break;
+                case Op::Min: for (long i = 0; i < n; ++i) out[i] = std::min(a[i], b[i]); break;
+                case Op::Max: for (long i = 0; i < n; ++i) out[i] = std::max(a[i], b[i]); break;
+                case Op::Clamp: for (long i = 0; i < n; ++i) out[i] = std::min(std::max(a[i], b[i]), c[i]); break;
+                case Op::Abs: for (long i = 0; i < n; ++i) out[i] = std::abs(a[i]); break;
+                case Op::Sqrt: for (long i = 0; i < n; ++i) out[i] = std::sqrt(a[i]); break;
+                case Op::Exp: for (long i = 0; i < n; ++i) out[i] = std::exp(a[i]); break;
+                case Op::Log: for (long i = 0; i < n; ++i) out[i] = std::log(a[i]); break;
+                case Op::Step: for (long i = 0; i < n; ++i) out[i] = a[i] >= b[i] ? 1.0f : 0.0f; break;
+                case Op::Select: for (long i = 0; i < n; ++i) out[i] = a[i] != 0 ? b[i] : c[i]; break;
+                default: break;
+            }
+            slots[top - 1] = out;
+        }
+
+        const float *result = slots[0];
+        float *target = destination + blockStart;
+        for (long i = 0; i < n; ++i)
+        {
+            target[i] += result[i] * weight;
+        }
+    }
+}
+
+void accumulateLayer(const string &filename, const LayerExpression &expression, float weight,
+                     float *cost, const float *elevation, long width, long height)
+{
+    const bool read = streamTIFF(filename, width, height,
+                                 [&](long x, long y, long tileWidth, long tileLength, const float *tile, long stride)
+    {
+        for (long row = 0; row < tileLength; ++row)
+        {
+            expression.accumulate(cost + (y + row) * width + x,
+                                  tile + row * stride,
+                                  elevation + (y + row) * width + x,
+                                  tileWidth,
+                                  weight);
+        }
+    });
+
+    if (!read)
+    {
+        throw std::runtime_error("Failed to read cost layer " + filename);
+    }
+}
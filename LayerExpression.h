@@ -0,0 +1,70 @@
+//
+// Per-layer cost expressions read from params.json.
+//
+
+#ifndef BREADCRUMBS_LAYEREXPRESSION_H
+#define BREADCRUMBS_LAYEREXPRESSION_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * An expression turning a cost layer's cell into a cost, such as "clamp(value, 0, 30) ^ 2".
+ * `value` is the layer's cell and `elevation` is the elevation at the same cell.
+ *
+ * Supports + - * / ^, comparisons (giving 1 or 0), min(a, b), max(a, b), clamp(x, low, high),
+ * abs, sqrt, exp, log, pow(a, b), step(x, edge) (1 where x >= edge) and select(mask, a, b)
+ * (a where mask is non-zero).
+ *
+ * The source is parsed once into a constant-folded stack program. accumulate() runs that
+ * program over blocks of cells small enough to stay in cache, one tight loop per operation,
+ * so a whole expression costs one pass over memory.
+ * Throws std::runtime_error if the source cannot be parsed.
+ */
+class LayerExpression
+{
+public:
+    explicit LayerExpression(const std::string &source = "value");
+
+    // True when the expression is just `value`, i.e. a plain weighted layer
+    bool isIdentity() const;
+    bool usesElevation() const;
+
+    // Evaluates a single cell
+    float evaluate(float value, float elevation) const;
+
+    /*
+     * destination[i] += f(values[i], elevation[i]) * weight for count cells.
+     * elevation may be null when usesElevation() is false.
+     */
+    void accumulate(float *destination, const float *values, const float *elevation, long count, float weight) const;
+
+    enum class Op : uint8_t
+    {
+        Value, Elevation, Constant,
+        Add, Subtract, Multiply, Divide, Power, Negate,
+        Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual,
+        Min, Max, Clamp, Abs, Sqrt, Exp, Log, Step, Select
+    };
+
+    struct Instruction
+    {
+        Op op;
+        float constant;
+    };
+
+private:
+    std::vector<Instruction> program;
+    int maxDepth = 0;
+};
+
+/*
+ * Streams a cost layer TIFF through an expression into a row-major raster of width by height
+ * costs, adding the expression times weight to each cell. elevation is row-major too.
+ * Throws std::runtime_error if the TIFF cannot be read or is not width by height.
+ */
+void accumulateLayer(const std::string &filename, const LayerExpression &expression, float weight,
+                     float *cost, const float *elevation, long width, long height);
+
+#endif //BREADCRUMBS_LAYEREXPRESSION_H
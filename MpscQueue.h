@@ -0,0 +1,74 @@
+//
+// A lock-free queue with many producers and a single consumer.
+//
+
+#ifndef BREADCRUMBS_MPSCQUEUE_H
+#define BREADCRUMBS_MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+/*
+ * Any number of threads may push, while only one thread pops.
+ * A push is one atomic exchange, and a pop never waits on a producer:
+ * a value whose push has not yet been linked in is simply not seen until it is.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue()
+        : head(new Node), tail(head.load(std::memory_order_relaxed))
+    {}
+
+    ~MpscQueue()
+    {
+        while (tail)
+        {
+            Node *next = tail->next.load(std::memory_order_relaxed);
+            delete tail;
+            tail = next;
+        }
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    void push(T value)
+    {
+        Node *node = new Node;
+        node->value = std::move(value);
+        Node *previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // Only the consumer may call this. Returns false if nothing has arrived.
+    bool tryPop(T &value)
+    {
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+        {
+            return false;
+        }
+
+        // The popped node becomes the new empty front
+        value = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node *> next{nullptr};
+        T value;
+    };
+
+    // Producers append here
+    std::atomic<Node *> head;
+    // The consumer's empty front node, whose successor is the oldest value
+    Node *tail;
+};
+
+#endif //BREADCRUMBS_MPSCQUEUE_H
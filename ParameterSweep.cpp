@@ -0,0 +1,170 @@
+//
+// The set of weights a test suite runs over.
+//
+
+#include <map>
+#include <cmath>
+#include <tuple>
+#include "ParameterSweep.h"
+
+using std::vector;
+using std::map;
+
+const char *weightsFieldName(WeightsField field)
+{
+    const char *names [] = {
+            "unitsPerPixel", "gradeBase", "gradeRadius", "movementCostXY", "movementCostZ", "heuristicXY", "heuristicZ"
+    };
+    return names[(int)field];
+}
+
+bool isIntegerField(int field)
+{
+    return field == (int)WeightsField::GradeBase || field == (int)WeightsField::GradeRadius;
+}
+
+ParameterSweep::ParameterSweep(const Weights &base)
+{
+    const Point point = {
+            base.unitsPerPixel,
+            (double)base.gradeBase,
+            (double)base.gradeRadius,
+            base.movementCostXY,
+            base.movementCostZ,
+            base.heuristicXY,
+            base.heuristicZ
+    };
+
+    for (int field = 0; field < weightsFieldCount; ++field)
+    {
+        axes[field].values = {point[field]};
+    }
+}
+
+void ParameterSweep::setAxis(WeightsField field, vector<double> values, SweepScale scale)
+{
+    if (isIntegerField((int)field))
+    {
+        for (auto &value : values)
+        {
+            value = std::round(value);
+        }
+    }
+
+    axes[(int)field] = {std::move(values), scale};
+}
+
+size_t ParameterSweep::gridSize() const
+{
+    size_t size = 1;
+    for (const auto &axis : axes)
+    {
+        size *= axis.values.size();
+    }
+    return size;
+}
+
+Weights ParameterSweep::weightsAt(const Point &point)
+{
+    return {
+            point[0],
+            (int)point[1],
+            (int)point[2],
+            point[3],
+            point[4],
+            point[5],
+            point[6]
+    };
+}
+
+double ParameterSweep::midpoint(int axis, double a, double b) const
+{
+    double middle = axes[axis].scale == SweepScale::Logarithmic && a > 0 && b > 0
+                    ? std::sqrt(a * b)
+                    : (a + b) / 2;
+    if (isIntegerField(axis))
+    {
+        middle = std::floor(middle);
+    }
+
+    return middle != a && middle != b ? middle : a;
+}
+
+size_t ParameterSweep::run(const std::function<uint64_t(const Weights &)> &runOne) const
+{
+    map<Point, uint64_t> fingerprints;
+    auto visit = [&](const Point &point)
+    {
+        auto found = fingerprints.find(point);
+        if (found == fingerprints.end())
+        {
+            found = fingerprints.emplace(point, runOne(weightsAt(point))).first;
+        }
+        return found->second;
+    };
+
+    // Two runs which differ along one axis
+    using Edge = std::tuple<Point, Point, int>;
+    vector<Edge> edges;
+
+    std::array<size_t, weightsFieldCount> index = {};
+    const size_t size = gridSize();
+    for (size_t i = 0; i < size; ++i)
+    {
+        Point point;
+        for (int axis = 0; axis < weightsFieldCount; ++axis)
+        {
+            point[axis] = axes[axis].values[index[axis]];
+        }
+        visit(point);
+
+        for (int axis = 0; axis < weightsFieldCount && refinements > 0; ++axis)
+        {
+            if (index[axis] > 0)
+            {
+                Point previous = point;
+                previous[axis] = axes[axis].values[index[axis] - 1];
+                edges.emplace_back(previous, point, axis);
+            }
+        }
+
+        // Counts through the grid with the last axis changing fastest
+        for (int axis = weightsFieldCount - 1; axis >= 0; --axis)
+        {
+            if (++index[axis] < axes[axis].values.size())
+            {
+                break;
+            }
+            index[axis] = 0;
+        }
+    }
+
+    for (int round = 0; round < refinements && !edges.empty(); ++round)
+    {
+        vector<Edge> refined;
+        for (const auto &edge : edges)
+        {
+            const auto &from = std::get<0>(edge);
+            const auto &to = std::get<1>(edge);
+            const int axis = std::get<2>(edge);
+            if (visit(from) == visit(to))
+            {
+                continue;
+            }
+
+            Point middle = from;
+            middle[axis] = midpoint(axis, from[axis], to[axis]);
+            if (middle[axis] == from[axis])
+            {
+                continue;
+            }
+
+            visit(middle);
+            refined.emplace_back(from, middle, axis);
+            refined.emplace_back(middle, to, axis);
+        }
+        edges = std::move(refined);
+    }
+
+    return fingerprints.size();
+}
@@ -0,0 +1,78 @@
+//
+// The set of weights a test suite runs over.
+//
+
+#ifndef BREADCRUMBS_PARAMETERSWEEP_H
+#define BREADCRUMBS_PARAMETERSWEEP_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "breadcrumbs.h"
+
+// Each field of Weights, in the order they are declared
+enum class WeightsField
+{
+    UnitsPerPixel, GradeBase, GradeRadius, MovementCostXY, MovementCostZ, HeuristicXY, HeuristicZ
+};
+
+const int weightsFieldCount = 7;
+
+// The field's name in params.json, e.g. "movementCostXY"
+const char *weightsFieldName(WeightsField field);
+
+// How midpoints between two values of an axis are placed when refining
+enum class SweepScale { Linear, Logarithmic };
+
+/*
+ * A grid of weights: every combination of the values given for each field.
+ * Fields which are not swept keep the value from the base weights.
+ *
+ * With refinement, any two neighbouring runs which took different paths have a run
+ * added between them, halving the step along the axis which separates them, and so
+ * on for as many rounds as requested. Regions of the grid where every run takes the
+ * same path are never subdivided, so most runs are spent where the path changes.
+ * Integer fields stop subdividing when no whole number lies between two runs.
+ */
+class ParameterSweep
+{
+public:
+    explicit ParameterSweep(const Weights &base);
+
+    // Sweeps a field over the given values, in order
+    void setAxis(WeightsField field, std::vector<double> values, SweepScale scale = SweepScale::Linear);
+
+    // Rounds of refinement after the grid has run; 0 runs the grid alone
+    void setRefinements(int rounds) { refinements = rounds; }
+
+    // Runs in the grid before any refinement
+    size_t gridSize() const;
+
+    /*
+     * Calls runOne(weights) for every point of the grid, in order with the last field
+     * changing fastest, and then for each point added by refinement.
+     * runOne returns a fingerprint of the path it found, such as routeFingerprint.
+     * Returns the total number of runs.
+     */
+    size_t run(const std::function<uint64_t(const Weights &)> &runOne) const;
+
+private:
+    using Point = std::array<double, weightsFieldCount>;
+
+    struct Axis
+    {
+        std::vector<double> values;
+        SweepScale scale = SweepScale::Linear;
+    };
+
+    static Weights weightsAt(const Point &point);
+
+    // The value between a and b along an axis, or a if there is none
+    double midpoint(int axis, double a, double b) const;
+
+    std::array<Axis, weightsFieldCount> axes;
+    int refinements = 0;
+};
+
+#endif //BREADCRUMBS_PARAMETERSWEEP_H
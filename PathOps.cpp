@@ -0,0 +1,207 @@
+//
+// Output stages for routes returned by getShortestPath.
+//
+
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include "PathOps.h"
+
+using std::vector;
+using std::string;
+using std::ofstream;
+using std::endl;
+
+vector<Cell> distinctCells(const Route &route)
+{
+    vector<Cell> cells;
+    for (const auto &leg : route)
+    {
+        cells.insert(cells.end(), leg.begin(), leg.end());
+    }
+
+    auto rowMajor = [](const Cell &a, const Cell &b) { return a.y < b.y || (a.y == b.y && a.x < b.x); };
+    auto same = [](const Cell &a, const Cell &b) { return a.x == b.x && a.y == b.y; };
+    std::sort(cells.begin(), cells.end(), rowMajor);
+    cells.erase(std::unique(cells.begin(), cells.end(), same), cells.end());
+
+    return cells;
+}
+
+uint64_t routeFingerprint(const Route &route)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint64_t value)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            hash = (hash ^ ((value >> (8 * i)) & 0xff)) * 1099511628211ull;
+        }
+    };
+
+    mix(route.size());
+    for (const auto &leg : route)
+    {
+        mix(leg.size());
+        for (const auto &cell : leg)
+        {
+            mix((uint64_t)cell.x);
+            mix((uint64_t)cell.y);
+        }
+    }
+
+    return hash;
+}
+
+void putVarint(vector<uint8_t> &bytes, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        bytes.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((uint8_t)value);
+}
+
+void putSigned(vector<uint8_t> &bytes, long value)
+{
+    putVarint(bytes, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+uint64_t getVarint(const vector<uint8_t> &bytes, size_t &position)
+{
+    uint64_t value = 0;
+    for (int shift = 0; position < bytes.size(); shift += 7)
+    {
+        const uint8_t byte = bytes[position++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+
+    throw std::runtime_error("Truncated route steps");
+}
+
+long getSigned(const vector<uint8_t> &bytes, size_t &position)
+{
+    const uint64_t value = getVarint(bytes, position);
+    return (long)(value >> 1) ^ -(long)(value & 1);
+}
+
+vector<uint8_t> encodeRouteSteps(const Route &route)
+{
+    vector<uint8_t> steps;
+    putVarint(steps, route.size());
+    Cell previous = {0, 0};
+    for (const auto &leg : route)
+    {
+        putVarint(steps, leg.size());
+        for (const auto &cell : leg)
+        {
+            putSigned(steps, cell.x - previous.x);
+            putSigned(steps, cell.y - previous.y);
+            previous = cell;
+        }
+    }
+
+    return steps;
+}
+
+Route decodeRouteSteps(const vector<uint8_t> &steps)
+{
+    size_t position = 0;
+    Cell previous = {0, 0};
+    Route route(getVarint(steps, position));
+    for (auto &leg : route)
+    {
+        leg.resize(getVarint(steps, position));
+        for (auto &cell : leg)
+        {
+            cell.x = previous.x + getSigned(steps, position);
+            cell.y = previous.y + getSigned(steps, position);
+            previous = cell;
+        }
+    }
+
+    return route;
+}
+
+void writeRouteToGeoJSON(const Route &route, const string &filename, const GeoReference &reference)
+{
+    ofstream out(filename);
+    // Seven decimal places of a degree place a cell to within about a centimetre
+    out << std::fixed;
+    out.precision(7);
+    out << "{\"type\":\"FeatureCollection\",\"features\":[";
+    for (size_t legIndex = 0; legIndex < route.size(); ++legIndex)
+    {
+        out << (legIndex ? "," : "") << endl
+            << "{\"type\":\"Feature\",\"properties\":{\"leg\":" << legIndex << "},"
+            << "\"geometry\":{\"type\":\"LineString\",\"coordinates\":[";
+        for (size_t i = 0; i < route[legIndex].size(); ++i)
+        {
+            const Cell &cell = route[legIndex][i];
+            out << (i ? "," : "") << "[" << reference.originX + cell.x * reference.columnStep
+                << "," << reference.originY + cell.y * reference.rowStep << "]";
+        }
+        out << "]}}";
+    }
+    out << endl << "]}" << endl;
+}
+
+void writeRouteToGPX(const Route &route, const string &filename, const GeoReference &reference)
+{
+    ofstream out(filename);
+    // Seven decimal places of a degree place a cell to within about a centimetre
+    out << std::fixed;
+    out.precision(7);
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << endl
+        << "<gpx version=\"1.1\" creator=\"breadcrumbs\" xmlns=\"http://www.topografix.com/GPX/1/1\">" << endl
+        << "<trk><name>breadcrumbs</name>" << endl;
+    for (const auto &leg : route)
+    {
+        out << "<trkseg>" << endl;
+        for (const auto &cell : leg)
+        {
+            out << "<trkpt lat=\"" << reference.originY + cell.y * reference.rowStep
+                << "\" lon=\"" << reference.originX + cell.x * reference.columnStep << "\"/>" << endl;
+        }
+        out << "</trkseg>" << endl;
+    }
+    out << "</trk>" << endl << "</gpx>" << endl;
+}
+
+bool hasExtension(const string &filename, const string &extension)
+{
+    return filename.size() >= extension.size()
+        && filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool isGeographicOutput(const string &filename)
+{
+    return hasExtension(filename, ".geojson") || hasExtension(filename, ".json") || hasExtension(filename, ".gpx");
+}
+
+void writeRoute(const Route &route, long width, long height, const string &filename, TiffCompression compression,
+                const GeoReference *reference)
+{
+    if (!isGeographicOutput(filename))
+    {
+        writeRouteToTIFF(route, width, height, filename, compression);
+    }
+    else if (!reference || !reference->geographic)
+    {
+        throw std::runtime_error("GeoJSON and GPX output need an elevation GeoTIFF in longitude and latitude: "
+                                 + filename);
+    }
+    else if (hasExtension(filename, ".gpx"))
+    {
+        writeRouteToGPX(route, filename, *reference);
+    }
+    else
+    {
+        writeRouteToGeoJSON(route, filename, *reference);
+    }
+}
@@ -0,0 +1,61 @@
+//
+// Output stages for routes returned by getShortestPath.
+//
+
+#ifndef BREADCRUMBS_PATHOPS_H
+#define BREADCRUMBS_PATHOPS_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "breadcrumbs.h"
+#include "TiffOps.h"
+
+/*
+ * Every distinct cell on a route, sorted by row and then by column.
+ * Cells shared by consecutive legs, or crossed twice, appear once.
+ */
+std::vector<Cell> distinctCells(const Route &route);
+
+/*
+ * A 64-bit FNV-1a hash of a route's legs and cells, in order.
+ * Routes with the same fingerprint are taken to be the same route.
+ */
+uint64_t routeFingerprint(const Route &route);
+
+/*
+ * A route as a list of leg lengths and zigzag varint steps between cells. Steps are almost
+ * always -1, 0 or 1, so each takes one byte, and the list deflates to a fraction of that.
+ * The form in which sweep archives and the route cache store routes.
+ */
+std::vector<uint8_t> encodeRouteSteps(const Route &route);
+
+// Throws std::runtime_error if the steps are truncated
+Route decodeRouteSteps(const std::vector<uint8_t> &steps);
+
+/*
+ * Writes a route to a GeoJSON FeatureCollection with one LineString per leg, each cell
+ * at its centre's [longitude, latitude] under a geographic reference.
+ */
+void writeRouteToGeoJSON(const Route &route, const std::string &filename, const GeoReference &reference);
+
+/*
+ * Writes a route to a GPX track with one segment per leg, each cell at its centre's
+ * longitude and latitude under a geographic reference.
+ */
+void writeRouteToGPX(const Route &route, const std::string &filename, const GeoReference &reference);
+
+/*
+ * Writes a route to a file whose format is chosen by its extension:
+ * .geojson or .json for GeoJSON, .gpx for GPX, and anything else for a
+ * width by height path raster TIFF with the given compression.
+ * Throws std::runtime_error for GeoJSON or GPX without a geographic reference,
+ * as both hold nothing but longitudes and latitudes.
+ */
+// Whether a file writeRoute would write holds longitudes and latitudes, and so needs a geographic reference
+bool isGeographicOutput(const std::string &filename);
+
+void writeRoute(const Route &route, long width, long height, const std::string &filename,
+                TiffCompression compression = TiffCompression::Deflate, const GeoReference *reference = nullptr);
+
+#endif //BREADCRUMBS_PATHOPS_H
@@ -0,0 +1,107 @@
+//
+// Compact integer storage for elevation and cost rasters.
+//
+
+#ifndef BREADCRUMBS_QUANTIZEDRASTER_H
+#define BREADCRUMBS_QUANTIZEDRASTER_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "breadcrumbs.h"
+
+/*
+ * A raster stored as 8 or 16-bit integer codes with one scale and offset for the
+ * whole raster, decoded inline as the search reads each cell.
+ * Codes span the range of the source matrix evenly. When the source holds only
+ * whole numbers which fit in the code range, such as a categorical layer,
+ * they are stored exactly.
+ * Cells which are not finite, such as NaN nodata, are given the highest code of their
+ * own and read back as NaN, so the search sees nodata where the source matrix had it.
+ */
+template <typename Code>
+class QuantizedRaster
+{
+public:
+    explicit QuantizedRaster(const Matrix &matrix)
+        : columns(rasterWidth(matrix)), rows(rasterHeight(matrix)), codes(columns * rows)
+    {
+        float minimum = std::numeric_limits<float>::max();
+        float maximum = std::numeric_limits<float>::lowest();
+        bool wholeNumbers = true;
+        bool anyNodata = false;
+        for (const auto &row : matrix)
+        {
+            for (const auto &cell : row)
+            {
+                if (!std::isfinite(cell))
+                {
+                    anyNodata = true;
+                    continue;
+                }
+                minimum = std::min(minimum, cell);
+                maximum = std::max(maximum, cell);
+                wholeNumbers = wholeNumbers && cell == std::round(cell);
+            }
+        }
+        if (maximum < minimum)
+        {
+            minimum = maximum = 0;
+        }
+
+        const double lowest = std::numeric_limits<Code>::lowest();
+        const double highest = (double)std::numeric_limits<Code>::max() - (anyNodata ? 1 : 0);
+        if (anyNodata)
+        {
+            nodata = std::numeric_limits<Code>::max();
+        }
+
+        const double levels = highest - lowest;
+        const double range = (double)maximum - minimum;
+        scale = (wholeNumbers && range <= levels) || range == 0 ? 1.0f : (float)(range / levels);
+        offset = minimum - scale * (float)lowest;
+
+        for (long y = 0; y < rows; ++y)
+        {
+            for (long x = 0; x < columns; ++x)
+            {
+                const float cell = matrix[y][x];
+                if (!std::isfinite(cell))
+                {
+                    codes[y * columns + x] = (Code)nodata;
+                    continue;
+                }
+                const double code = std::round((cell - offset) / (double)scale);
+                codes[y * columns + x] = (Code)std::min<double>(std::max<double>(code, lowest), highest);
+                error = std::max(error, std::abs(at(x, y) - cell));
+            }
+        }
+    }
+
+    long width() const { return columns; }
+    long height() const { return rows; }
+
+    float at(long x, long y) const
+    {
+        const Code code = codes[y * columns + x];
+        return (int)code == nodata ? std::numeric_limits<float>::quiet_NaN() : offset + scale * code;
+    }
+
+    void prefetch(long, long) const {}
+
+    // The largest difference between a finite source cell and its decoded value
+    float maxError() const { return error; }
+
+private:
+    long columns;
+    long rows;
+    std::vector<Code> codes;
+    float scale = 1;
+    float offset = 0;
+    float error = 0;
+    // The code of cells which are not finite, or -1, which no code matches, if there are none
+    int nodata = -1;
+};
+
+#endif //BREADCRUMBS_QUANTIZEDRASTER_H
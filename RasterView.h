@@ -0,0 +1,32 @@
+//
+// A raster over cells held by someone else.
+//
+
+#ifndef BREADCRUMBS_RASTERVIEW_H
+#define BREADCRUMBS_RASTERVIEW_H
+
+/*
+ * Reads a row-major array of floats in place, so a raster already in memory,
+ * such as a buffer handed over by a caller in another language, can be searched
+ * without copying it into a Matrix. The cells must outlive the view and must not
+ * change while a search reads them.
+ */
+class RasterView
+{
+public:
+    RasterView(const float *cells, long width, long height)
+        : cells(cells), columns(width), rows(height)
+    {}
+
+    long width() const { return columns; }
+    long height() const { return rows; }
+    float at(long x, long y) const { return cells[y * columns + x]; }
+    void prefetch(long, long) const {}
+
+private:
+    const float *cells;
+    long columns;
+    long rows;
+};
+
+#endif //BREADCRUMBS_RASTERVIEW_H
@@ -0,0 +1,198 @@
+//
+// Routes already found, kept on disk by the content of the request which found them.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <stdexcept>
+#include <filesystem>
+#include "zlib.h"
+#include "RouteCache.h"
+#include "PathOps.h"
+
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+
+namespace fs = std::filesystem;
+
+// Marks every entry, and changes whenever the search could give a different route for the same inputs
+const char entryMagic [] = "BCROUTE1";
+
+// Bytes of a file hashed at a time
+const size_t digestChunk = 1 << 20;
+
+/*
+ * Mixes whole words into two lanes with different multipliers,
+ * and any remaining bytes one at a time.
+ */
+ContentHash &ContentHash::add(const void *data, size_t bytes)
+{
+    const auto *input = static_cast<const uint8_t *>(data);
+    auto mix = [this](uint64_t word)
+    {
+        low = (low ^ word) * 0xff51afd7ed558ccdull;
+        low ^= low >> 32;
+        high = (high ^ word) * 0xc4ceb9fe1a85ec53ull;
+        high ^= high >> 29;
+    };
+
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, input + i, sizeof(word));
+        mix(word);
+    }
+    for (; i < bytes; ++i)
+    {
+        mix(input[i]);
+    }
+    mix(bytes);
+
+    return *this;
+}
+
+ContentHash &ContentHash::add(const string &text)
+{
+    return add(text.data(), text.size());
+}
+
+ContentHash &ContentHash::add(double value)
+{
+    return add(&value, sizeof(value));
+}
+
+ContentHash &ContentHash::add(long value)
+{
+    return add(&value, sizeof(value));
+}
+
+ContentHash &ContentHash::add(const Weights &weights)
+{
+    return add(weights.unitsPerPixel).add((long)weights.gradeBase).add((long)weights.gradeRadius)
+          .add(weights.movementCostXY).add(weights.movementCostZ)
+          .add(weights.heuristicXY).add(weights.heuristicZ);
+}
+
+string ContentHash::hex() const
+{
+    char digits[33];
+    std::snprintf(digits, sizeof(digits), "%016llx%016llx", (unsigned long long)high, (unsigned long long)low);
+    return digits;
+}
+
+RouteCache::RouteCache(const string &directory)
+    : directory(directory)
+{
+    std::error_code error;
+    fs::create_directories(fs::path(directory) / "files", error);
+    if (error)
+    {
+        throw std::runtime_error("Unable to create route cache " + directory);
+    }
+}
+
+string RouteCache::fileDigest(const string &filename) const
+{
+    std::error_code error;
+    const auto size = fs::file_size(filename, error);
+    const auto modified = fs::last_write_time(filename, error).time_since_epoch().count();
+    if (error)
+    {
+        throw std::runtime_error("Unable to read " + filename);
+    }
+
+    const string memoFilename = (fs::path(directory) / "files" /
+                                 ContentHash().add(fs::absolute(filename).string()).hex()).string();
+    {
+        ifstream memo(memoFilename);
+        uintmax_t memoSize;
+        long long memoModified;
+        string digest;
+        if (memo >> memoSize >> memoModified >> digest && memoSize == size && memoModified == modified)
+        {
+            return digest;
+        }
+    }
+
+    ifstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Unable to read " + filename);
+    }
+
+    ContentHash hash;
+    vector<char> chunk(digestChunk);
+    while (file.read(chunk.data(), chunk.size()) || file.gcount() > 0)
+    {
+        hash.add(chunk.data(), file.gcount());
+    }
+    const string digest = hash.hex();
+
+    const string temporary = memoFilename + ".tmp";
+    {
+        ofstream memo(temporary);
+        memo << size << ' ' << modified << ' ' << digest << '\n';
+    }
+    fs::rename(temporary, memoFilename, error);
+
+    return digest;
+}
+
+bool RouteCache::load(const string &key, Route &route, long &width, long &height) const
+{
+    ifstream entry((fs::path(directory) / (key + ".route")).string(), std::ios::binary);
+    string magic;
+    uLongf rawBytes;
+    if (!(entry >> magic >> width >> height >> rawBytes) || magic != entryMagic || entry.get() != '\n')
+    {
+        return false;
+    }
+
+    const vector<uint8_t> encoded((std::istreambuf_iterator<char>(entry)), std::istreambuf_iterator<char>());
+    vector<uint8_t> raw(rawBytes);
+    if (uncompress(raw.data(), &rawBytes, encoded.data(), encoded.size()) != Z_OK || rawBytes != raw.size())
+    {
+        return false;
+    }
+
+    try
+    {
+        route = decodeRouteSteps(raw);
+    }
+    catch(std::runtime_error &)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool RouteCache::store(const string &key, const Route &route, long width, long height) const
+{
+    const auto raw = encodeRouteSteps(route);
+    uLongf encodedBytes = compressBound(raw.size());
+    vector<uint8_t> encoded(encodedBytes);
+    compress2(encoded.data(), &encodedBytes, raw.data(), raw.size(), Z_DEFAULT_COMPRESSION);
+
+    const string entryFilename = (fs::path(directory) / (key + ".route")).string();
+    const string temporary = entryFilename + ".tmp";
+    {
+        ofstream entry(temporary, std::ios::binary | std::ios::trunc);
+        entry << entryMagic << ' ' << width << ' ' << height << ' ' << raw.size() << '\n';
+        entry.write(reinterpret_cast<const char *>(encoded.data()), encodedBytes);
+        if (!entry)
+        {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    fs::rename(temporary, entryFilename, error);
+    return !error;
+}
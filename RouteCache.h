@@ -0,0 +1,63 @@
+//
+// Routes already found, kept on disk by the content of the request which found them.
+//
+
+#ifndef BREADCRUMBS_ROUTECACHE_H
+#define BREADCRUMBS_ROUTECACHE_H
+
+#include <string>
+#include <cstdint>
+#include "breadcrumbs.h"
+
+/*
+ * A 128-bit hash of everything added to it, in order.
+ * Not cryptographic, but wide enough that distinct requests never share a key in practice.
+ */
+class ContentHash
+{
+public:
+    ContentHash &add(const void *data, size_t bytes);
+    ContentHash &add(const std::string &text);
+    ContentHash &add(double value);
+    ContentHash &add(long value);
+    ContentHash &add(const Weights &weights);
+
+    // 32 hex digits
+    std::string hex() const;
+
+private:
+    uint64_t low = 0x9e3779b97f4a7c15ull;
+    uint64_t high = 0xc2b2ae3d27d4eb4full;
+};
+
+/*
+ * A directory of routes, each stored under the hash of the inputs which produced it:
+ * the rasters' contents, the cost layers, the control points and the weights.
+ * An entry is written to a temporary file and renamed into place, so an interrupted
+ * run never leaves a partial entry behind, and a sweep which is run again only
+ * searches the runs it had not finished.
+ */
+class RouteCache
+{
+public:
+    // Creates the directory if needed. Throws std::runtime_error if it cannot be created.
+    explicit RouteCache(const std::string &directory);
+
+    /*
+     * The hash of a file's contents. It is remembered by path, size and modification
+     * time, so an unchanged file is only read the first time.
+     * Throws std::runtime_error if the file cannot be read.
+     */
+    std::string fileDigest(const std::string &filename) const;
+
+    // Reads the route stored under key and the size of its raster. Returns false if there is none.
+    bool load(const std::string &key, Route &route, long &width, long &height) const;
+
+    // Returns false if the route could not be stored
+    bool store(const std::string &key, const Route &route, long width, long height) const;
+
+private:
+    std::string directory;
+};
+
+#endif //BREADCRUMBS_ROUTECACHE_H
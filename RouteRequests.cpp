@@ -0,0 +1,439 @@
+//
+// Route requests as JSON lines, answered against terrain kept loaded between them.
+//
+
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <chrono>
+#include <stdexcept>
+#include "RouteRequests.h"
+#include "RouteServer.h"
+#include "JsonOps.h"
+#include "TiffOps.h"
+#include "ThreadPool.h"
+#include "SearchControl.h"
+#include "breadcrumbs.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using std::ifstream;
+
+/*
+ * The elevation, default parameters and thread pool which a server keeps loaded between
+ * requests. The cost matrix for each distinct list of layers is built the first time it
+ * is asked for and kept, so requests sharing layers share one matrix.
+ */
+struct ResidentTerrain
+{
+    Matrix elevation;
+    // params.json, whose layers and weights are used by requests which do not give their own
+    nlohmann::json defaults;
+    // Builds cost matrices and runs parallel searches. Without one, only matrices already built can be used.
+    ThreadPool *pool = nullptr;
+
+    // Guards the map only. Each matrix is built outside it, so requests for matrices which
+    // are already built never wait behind another request's new layers.
+    std::mutex costsMutex;
+    std::map<string, std::shared_future<std::shared_ptr<const Matrix>>> costs;
+
+    // The parallel search needs every thread of the pool at once, so parallel searches take turns
+    std::mutex parallelSearchMutex;
+
+    // How long a request which does not give its own "timeout" may search for, or 0 for no limit
+    double timeoutMilliseconds = 0;
+
+    // The tokens of requests being searched, by their id as JSON, so that a cancel request can stop them
+    std::mutex searchesMutex;
+    std::multimap<string, CancellationToken *> searches;
+};
+
+/*
+ * The cost matrix for a list of layers, built on first use with the terrain's pool.
+ * Throws std::runtime_error if a layer cannot be read, or if the matrix was not built and there is no pool.
+ */
+std::shared_ptr<const Matrix> residentCost(ResidentTerrain &terrain, const nlohmann::json &layers)
+{
+    const string key = layers.dump();
+    std::promise<std::shared_ptr<const Matrix>> building;
+    std::shared_future<std::shared_ptr<const Matrix>> cost;
+    bool builder = false;
+    {
+        std::lock_guard<std::mutex> lock(terrain.costsMutex);
+        auto found = terrain.costs.find(key);
+        if (found != terrain.costs.end())
+        {
+            cost = found->second;
+        }
+        else
+        {
+            if (!terrain.pool)
+            {
+                throw std::runtime_error("Cost layers were not loaded");
+            }
+            cost = terrain.costs.emplace(key, building.get_future().share()).first->second;
+            builder = true;
+        }
+    }
+
+    // Requests for the same layers meanwhile wait on the future, and share the matrix or the error
+    if (builder)
+    {
+        try
+        {
+            building.set_value(std::make_shared<const Matrix>(getCostMatrix(terrain.elevation, layers, *terrain.pool)));
+        }
+        catch(...)
+        {
+            // Forgotten, so a later request tries again, as it would have before the matrix was kept
+            {
+                std::lock_guard<std::mutex> lock(terrain.costsMutex);
+                terrain.costs.erase(key);
+            }
+            building.set_exception(std::current_exception());
+        }
+    }
+    return cost.get();
+}
+
+// Lists a search's token under its request's id for as long as it runs
+class RegisteredSearch
+{
+public:
+    RegisteredSearch(ResidentTerrain &terrain, const string &key, CancellationToken &cancellation)
+        : terrain(terrain)
+    {
+        std::lock_guard<std::mutex> lock(terrain.searchesMutex);
+        entry = terrain.searches.emplace(key, &cancellation);
+    }
+
+    ~RegisteredSearch()
+    {
+        std::lock_guard<std::mutex> lock(terrain.searchesMutex);
+        terrain.searches.erase(entry);
+    }
+
+    RegisteredSearch(const RegisteredSearch &) = delete;
+    RegisteredSearch &operator=(const RegisteredSearch &) = delete;
+
+private:
+    ResidentTerrain &terrain;
+    std::multimap<string, CancellationToken *>::iterator entry;
+};
+
+/*
+ * Cancels every request being searched whose id is the "cancel" of a request, such as
+ * {"id": 8, "cancel": 7}. Answers with how many searches were cancelled.
+ */
+nlohmann::json answerCancelRequest(ResidentTerrain &terrain, const nlohmann::json &request)
+{
+    long cancelled = 0;
+    {
+        std::lock_guard<std::mutex> lock(terrain.searchesMutex);
+        const auto searches = terrain.searches.equal_range(request["cancel"].dump());
+        for (auto search = searches.first; search != searches.second; ++search)
+        {
+            search->second->cancel();
+            ++cancelled;
+        }
+    }
+    return {{"id", request.value("id", nlohmann::json())}, {"cancelled", cancelled}};
+}
+
+/*
+ * Routes one request against resident terrain. A request is a JSON object holding
+ * "points", and optionally its own "layers" and "weights" in the form of params.json,
+ * "parallel": true to route with the parallel search if the terrain has a pool,
+ * or else with the sequential one, which the answer says in a "warning",
+ * a "timeout" in milliseconds after which the search gives up,
+ * "instrument": true to have the stats include the search's counters and timings,
+ * and an "id" which is echoed back, and by which the search can be cancelled.
+ * A request holding "cancel" instead cancels searches, see answerCancelRequest.
+ * Answers with the cells of each leg as [x, y] pairs and the route's stats,
+ * or with an "error" if the request could not be routed. A search which was cancelled
+ * or timed out also answers with its "status" and the stats of what it searched.
+ */
+nlohmann::json answerRouteRequest(ResidentTerrain &terrain, const nlohmann::json &request)
+{
+    if (request.contains("cancel"))
+    {
+        return answerCancelRequest(terrain, request);
+    }
+
+    nlohmann::json answer;
+    answer["id"] = request.value("id", nlohmann::json());
+    try
+    {
+        const auto points = getControlPoints(request.at("points"));
+        if (points.size() < 2)
+        {
+            throw std::runtime_error("A route needs at least two points");
+        }
+        for (const auto &point : points)
+        {
+            if (point.x < 0 || point.y < 0 || point.x >= rasterWidth(terrain.elevation)
+                || point.y >= rasterHeight(terrain.elevation))
+            {
+                throw std::runtime_error("Point (" + std::to_string(point.x) + ", " + std::to_string(point.y)
+                                         + ") is outside the raster");
+            }
+        }
+
+        const auto weights = getWeights(request.contains("weights") ? request["weights"]
+                                                                    : terrain.defaults.at("weights"));
+        const auto cost = residentCost(terrain, request.contains("layers")
+                                                ? request["layers"]
+                                                : terrain.defaults.value("layers", nlohmann::json::array()));
+
+        const auto start = std::chrono::steady_clock::now();
+        CancellationToken cancellation(
+                CancellationToken::deadlineAfter(request.value("timeout", terrain.timeoutMilliseconds)));
+        const RegisteredSearch registered(terrain, answer["id"].dump(), cancellation);
+
+        Route route;
+        SearchStats searchStats;
+        searchStats.instrument = request.value("instrument", false);
+        if (request.value("parallel", false) && terrain.pool)
+        {
+            std::lock_guard<std::mutex> lock(terrain.parallelSearchMutex);
+            route = getShortestPath(terrain.elevation, *cost, points, weights, *terrain.pool,
+                                    &cancellation, &searchStats);
+        }
+        else
+        {
+            if (request.value("parallel", false))
+            {
+                answer["warning"] = "Routed with the sequential search, as batch jobs already share the threads";
+            }
+            route = getShortestPath(terrain.elevation, *cost, points, weights, nullptr,
+                                    &cancellation, &searchStats);
+        }
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (searchStats.status != SearchStatus::Complete)
+        {
+            answer["status"] = searchStatusName(searchStats.status);
+            answer["error"] = searchStats.status == SearchStatus::TimedOut ? "Search timed out" : "Search cancelled";
+            answer["stats"] = {
+                    {"expanded", searchStats.expanded},
+                    {"legs", searchStats.legs},
+                    {"milliseconds", elapsed.count()}
+            };
+            if (searchStats.instrument)
+            {
+                answer["stats"]["search"] = searchStatsJson(searchStats);
+            }
+            return answer;
+        }
+
+        auto &legs = answer["route"] = nlohmann::json::array();
+        size_t cells = 0;
+        for (const auto &leg : route)
+        {
+            auto &legJson = legs.emplace_back(nlohmann::json::array());
+            for (const auto &cell : leg)
+            {
+                legJson.push_back({cell.x, cell.y});
+            }
+            cells += leg.size();
+        }
+        answer["stats"] = {
+                {"cells", cells},
+                {"cost", getRouteCost(terrain.elevation, *cost, route, weights)},
+                {"expanded", searchStats.expanded},
+                {"milliseconds", elapsed.count()}
+        };
+        if (searchStats.instrument)
+        {
+            answer["stats"]["search"] = searchStatsJson(searchStats);
+        }
+    }
+    catch(std::exception &e)
+    {
+        answer.erase("route");
+        answer["error"] = e.what();
+    }
+
+    return answer;
+}
+
+/*
+ * Reads the elevation and params.json into resident terrain, and builds the cost matrix
+ * for the layers in params.json. Returns false, having said why on standard error, if any can't be read.
+ */
+bool loadResidentTerrain(ResidentTerrain &terrain, const string &elevationFilename, const string &paramsFilename)
+{
+    terrain.elevation = readTIFF(elevationFilename);
+    if (terrain.elevation.empty())
+    {
+        std::cerr << "Failed to read TIFF " << elevationFilename << endl;
+        return false;
+    }
+
+    try
+    {
+        terrain.defaults = readJSON(paramsFilename);
+        residentCost(terrain, terrain.defaults.value("layers", nlohmann::json::array()));
+    }
+    catch(std::exception &e)
+    {
+        std::cerr << e.what() << endl;
+        return false;
+    }
+
+    return true;
+}
+
+int serveRoutes(const string &elevationFilename, const string &paramsFilename, const string &socketPath,
+                ThreadPool &pool, double timeoutMilliseconds)
+{
+    ResidentTerrain terrain;
+    terrain.pool = &pool;
+    terrain.timeoutMilliseconds = timeoutMilliseconds;
+    if (!loadResidentTerrain(terrain, elevationFilename, paramsFilename))
+    {
+        return -1;
+    }
+
+    std::cerr << "Serving routes over " << elevationFilename << " (" << rasterWidth(terrain.elevation) << " x "
+              << rasterHeight(terrain.elevation) << ")" << endl;
+
+    const LineHandler handler = [&terrain](const string &line)
+    {
+        nlohmann::json answer;
+        try
+        {
+            answer = answerRouteRequest(terrain, nlohmann::json::parse(line));
+        }
+        catch(nlohmann::json::exception &e)
+        {
+            answer = {{"id", nullptr}, {"error", e.what()}};
+        }
+        // A request with invalid UTF-8 can be echoed into an error, which must still be answered
+        return answer.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+    };
+
+    if (socketPath.empty())
+    {
+        serveLines(std::cin, cout, handler);
+        return 0;
+    }
+
+    try
+    {
+        serveUnixSocket(socketPath, handler);
+    }
+    catch(std::runtime_error &e)
+    {
+        std::cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
+
+int runBatch(const string &elevationFilename, const string &paramsFilename, const string &jobsFilename,
+             ThreadPool &pool, double timeoutMilliseconds)
+{
+    ResidentTerrain terrain;
+    terrain.pool = &pool;
+    terrain.timeoutMilliseconds = timeoutMilliseconds;
+    if (!loadResidentTerrain(terrain, elevationFilename, paramsFilename))
+    {
+        return -1;
+    }
+
+    ifstream jobsFile(jobsFilename);
+    if (!jobsFile)
+    {
+        std::cerr << "Unable to read " << jobsFilename << endl;
+        return -1;
+    }
+
+    std::mutex outputMutex;
+    long answered = 0;
+    long failed = 0;
+    auto writeAnswer = [&](const nlohmann::json &answer)
+    {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        ++answered;
+        if (answer.contains("error"))
+        {
+            ++failed;
+        }
+        cout << answer.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) << endl;
+    };
+
+    vector<nlohmann::json> jobs;
+    string line;
+    for (long lineNumber = 1; std::getline(jobsFile, line); ++lineNumber)
+    {
+        if (line.find_first_not_of(" \t\r") == string::npos)
+        {
+            continue;
+        }
+        try
+        {
+            auto job = nlohmann::json::parse(line);
+            if (!job.contains("id"))
+            {
+                job["id"] = lineNumber;
+            }
+            jobs.push_back(std::move(job));
+        }
+        catch(nlohmann::json::exception &e)
+        {
+            writeAnswer({{"id", lineNumber}, {"error", e.what()}});
+        }
+    }
+
+    // Jobs run on the pool, so every cost matrix is built first, while the pool is free to build it
+    std::map<string, string> layerErrors;
+    for (const auto &job : jobs)
+    {
+        if (job.contains("layers") && !layerErrors.count(job["layers"].dump()))
+        {
+            try
+            {
+                residentCost(terrain, job["layers"]);
+            }
+            catch(std::exception &e)
+            {
+                layerErrors[job["layers"].dump()] = e.what();
+            }
+        }
+    }
+    // Jobs asking for the parallel search are routed sequentially, and their answers warn of it
+    terrain.pool = nullptr;
+
+    std::cerr << "Jobs: " << jobs.size() << ", cost layer sets: " << terrain.costs.size() << endl;
+
+    const auto start = std::chrono::steady_clock::now();
+    vector<std::future<void>> pending;
+    for (const auto &job : jobs)
+    {
+        const auto layerError = job.contains("layers") ? layerErrors.find(job["layers"].dump()) : layerErrors.end();
+        if (layerError != layerErrors.end())
+        {
+            writeAnswer({{"id", job["id"]}, {"error", layerError->second}});
+            continue;
+        }
+        pending.push_back(pool.submit([&terrain, &job, &writeAnswer]
+        {
+            writeAnswer(answerRouteRequest(terrain, job));
+        }));
+    }
+    for (auto &job : pending)
+    {
+        job.get();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cerr << "Answered " << answered << " jobs in " << elapsed.count() << " s, errors: " << failed << endl;
+
+    return 0;
+}
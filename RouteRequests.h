@@ -0,0 +1,33 @@
+//
+// Route requests as JSON lines, answered against terrain kept loaded between them.
+//
+
+#ifndef BREADCRUMBS_ROUTEREQUESTS_H
+#define BREADCRUMBS_ROUTEREQUESTS_H
+
+#include <string>
+
+class ThreadPool;
+
+/*
+ * Loads the elevation and the cost layers in params.json once, then answers route
+ * requests as JSON lines, from standard input or, if a socket path is given, from
+ * each client of a Unix domain socket. Progress goes to standard error, so standard
+ * output holds nothing but answers. Each search gives up after timeoutMilliseconds,
+ * if above 0, unless its request gives its own "timeout".
+ */
+int serveRoutes(const std::string &elevationFilename, const std::string &paramsFilename,
+                const std::string &socketPath, ThreadPool &pool, double timeoutMilliseconds);
+
+/*
+ * Routes every job in a file of JSON lines, each a request as serveRoutes answers,
+ * against rasters loaded once. The cost matrix for each distinct list of layers is built
+ * before any job runs and shared read-only between them. Jobs are then spread over the
+ * pool's threads, each searching sequentially, and each answer is written to standard
+ * output as a JSON line as soon as its job completes, so answers arrive out of order.
+ * A job without an "id" is given its line number. Jobs time out as in serveRoutes.
+ */
+int runBatch(const std::string &elevationFilename, const std::string &paramsFilename,
+             const std::string &jobsFilename, ThreadPool &pool, double timeoutMilliseconds);
+
+#endif //BREADCRUMBS_ROUTEREQUESTS_H
@@ -0,0 +1,129 @@
+//
+// Serves requests one line at a time, over standard input or a Unix domain socket.
+//
+
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "RouteServer.h"
+
+using std::string;
+
+// Bytes read from a connection at a time
+const size_t receiveChunk = 1 << 16;
+
+void serveLines(std::istream &input, std::ostream &output, const LineHandler &handler)
+{
+    string line;
+    while (std::getline(input, line))
+    {
+        if (line.find_first_not_of(" \t\r") == string::npos)
+        {
+            continue;
+        }
+        output << handler(line) << std::endl;
+    }
+}
+
+// Writes all of text to a connection. Returns false if the client has gone.
+bool sendAll(int connection, const string &text)
+{
+    size_t sent = 0;
+    while (sent < text.size())
+    {
+        // A client which hangs up must not end the server with SIGPIPE
+        const ssize_t written = send(connection, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0)
+        {
+            return false;
+        }
+        sent += written;
+    }
+    return true;
+}
+
+// Serves one connection until the client closes it
+void serveConnection(int connection, const LineHandler &handler)
+{
+    string pending;
+    char chunk[receiveChunk];
+    bool open = true;
+    while (open)
+    {
+        const ssize_t received = recv(connection, chunk, sizeof(chunk), 0);
+        if (received <= 0)
+        {
+            break;
+        }
+        pending.append(chunk, received);
+
+        size_t start = 0;
+        for (size_t end; open && (end = pending.find('\n', start)) != string::npos; start = end + 1)
+        {
+            const string line = pending.substr(start, end - start);
+            if (line.find_first_not_of(" \t\r") != string::npos)
+            {
+                open = sendAll(connection, handler(line) + "\n");
+            }
+        }
+        pending.erase(0, start);
+    }
+
+    close(connection);
+}
+
+void serveUnixSocket(const string &path, const LineHandler &handler)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("Socket path is too long: " + path);
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        throw std::runtime_error("Unable to create socket " + path);
+    }
+
+    // Only a socket left by an earlier server is replaced, never a file given by mistake
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0)
+    {
+        if (!S_ISSOCK(existing.st_mode))
+        {
+            close(listener);
+            throw std::runtime_error("Not a socket, so not replacing it: " + path);
+        }
+        unlink(path.c_str());
+    }
+    else if (errno != ENOENT)
+    {
+        close(listener);
+        throw std::runtime_error("Unable to check socket path " + path + ": " + std::strerror(errno));
+    }
+
+    if (bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0
+        || listen(listener, SOMAXCONN) != 0)
+    {
+        close(listener);
+        throw std::runtime_error("Unable to listen on socket " + path);
+    }
+
+    while (true)
+    {
+        const int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0)
+        {
+            continue;
+        }
+        std::thread(serveConnection, connection, std::cref(handler)).detach();
+    }
+}
@@ -0,0 +1,31 @@
+//
+// Serves requests one line at a time, over standard input or a Unix domain socket.
+//
+
+#ifndef BREADCRUMBS_ROUTESERVER_H
+#define BREADCRUMBS_ROUTESERVER_H
+
+#include <string>
+#include <iostream>
+#include <functional>
+
+// Answers one request line with one response line, without the newline
+using LineHandler = std::function<std::string(const std::string &)>;
+
+/*
+ * Answers each line of input in order, flushing each answer as it is written,
+ * until the input ends. Blank lines are skipped.
+ */
+void serveLines(std::istream &input, std::ostream &output, const LineHandler &handler);
+
+/*
+ * Listens on a Unix domain socket at the given path, replacing any socket left there,
+ * and serves each connection as serveLines does, on its own thread, so a slow
+ * request from one client does not hold up another. The handler must be safe to call
+ * from several threads at once. Runs until the process is stopped.
+ * Throws std::runtime_error if the socket cannot be created, or if something other
+ * than a socket is at the path.
+ */
+void serveUnixSocket(const std::string &path, const LineHandler &handler);
+
+#endif //BREADCRUMBS_ROUTESERVER_H
@@ -0,0 +1,120 @@
+//
+// Stopping a running search, and what it had done when it returned.
+//
+
+#ifndef BREADCRUMBS_SEARCHCONTROL_H
+#define BREADCRUMBS_SEARCHCONTROL_H
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+// Whether a search ran to the end, or why it stopped early
+enum class SearchStatus { Complete, Cancelled, TimedOut };
+
+// The status's name in JSON answers, e.g. "timedOut"
+inline const char *searchStatusName(SearchStatus status)
+{
+    switch (status)
+    {
+        case SearchStatus::Cancelled: return "cancelled";
+        case SearchStatus::TimedOut: return "timedOut";
+        default: return "complete";
+    }
+}
+
+/*
+ * What an instrumented search did in one leg. For the parallel search, the open list
+ * counts and times are summed over its threads, and cells sent between threads are
+ * counted but not timed.
+ */
+struct LegStats
+{
+    long expanded = 0;
+    // Cells put on the open list
+    long pushes = 0;
+    // Cells taken off the open list and skipped, as a cheaper route to them was queued since
+    long stalePops = 0;
+    // The most cells on the open list at once
+    long peakOpen = 0;
+    // Bytes the leg's bookkeeping and open list took at their largest
+    long bytesAllocated = 0;
+    double milliseconds = 0;
+    /*
+     * Estimated by timing one expansion in every few: evaluating the cost of steps,
+     * which gradeCost dominates, and pushing and popping the open list.
+     * The rest of the leg's time goes to bookkeeping and reading the rasters.
+     */
+    double stepCostMilliseconds = 0;
+    double queueMilliseconds = 0;
+};
+
+// What a search did, filled in as it returns
+struct SearchStats
+{
+    SearchStatus status = SearchStatus::Complete;
+    // Cells expanded over every leg, including the one it stopped in
+    long expanded = 0;
+    // Legs searched to their target. A search which stopped early returns only these.
+    long legs = 0;
+    /*
+     * Set before searching to have legStats filled in, one for each leg searched,
+     * including one it stopped in. Left unset, the search counts and times nothing more.
+     */
+    bool instrument = false;
+    std::vector<LegStats> legStats;
+};
+
+/*
+ * Lets any thread stop searches running on others, either by cancelling them
+ * or by a deadline given up front. A search checks its token once every
+ * checkInterval expansions, so it stops within a fraction of a millisecond
+ * without reading the clock for every cell, and returns the legs it finished.
+ */
+class CancellationToken
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr long checkInterval = 1024;
+
+    explicit CancellationToken(Clock::time_point deadline = Clock::time_point::max())
+        : deadline(deadline)
+    {}
+
+    // The deadline this many milliseconds from now, or none if it is not above 0 or is centuries away
+    static Clock::time_point deadlineAfter(double milliseconds)
+    {
+        if (!(milliseconds > 0 && milliseconds < 1e13))
+        {
+            return Clock::time_point::max();
+        }
+        return Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double, std::milli>(milliseconds));
+    }
+
+    // Safe to call from any thread, and from a signal handler
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+
+    // Complete while a search may go on, otherwise why it must stop
+    SearchStatus check() const
+    {
+        if (cancelled.load(std::memory_order_relaxed))
+        {
+            return SearchStatus::Cancelled;
+        }
+        if (deadline != Clock::time_point::max() && Clock::now() >= deadline)
+        {
+            return SearchStatus::TimedOut;
+        }
+        return SearchStatus::Complete;
+    }
+
+private:
+    static_assert(std::atomic<bool>::is_always_lock_free, "cancel() must be safe in a signal handler");
+
+    std::atomic<bool> cancelled{false};
+    const Clock::time_point deadline;
+};
+
+#endif //BREADCRUMBS_SEARCHCONTROL_H
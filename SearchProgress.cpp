@@ -0,0 +1,24 @@
+//
+// Snapshots of a running search, passed to one reader without locking.
+//
+
+#include <utility>
+#include "SearchProgress.h"
+
+void SearchProgress::publish(SearchSnapshot snapshot)
+{
+    buffers[back] = std::move(snapshot);
+    back = middle.exchange(back | fresh, std::memory_order_acq_rel) & indexMask;
+}
+
+bool SearchProgress::read(SearchSnapshot &snapshot)
+{
+    if (!(middle.load(std::memory_order_acquire) & fresh))
+    {
+        return false;
+    }
+
+    front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+    snapshot = buffers[front];
+    return true;
+}
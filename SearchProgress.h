@@ -0,0 +1,73 @@
+//
+// Snapshots of a running search, passed to one reader without locking.
+//
+
+#ifndef BREADCRUMBS_SEARCHPROGRESS_H
+#define BREADCRUMBS_SEARCHPROGRESS_H
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include "breadcrumbs.h"
+
+// How a search stood when it published a snapshot
+struct SearchSnapshot
+{
+    // The leg being searched, from 0
+    long leg = 0;
+    // Cells expanded so far in this leg
+    long expanded = 0;
+    // The route from the leg's start to the cell most recently expanded, the most promising so far
+    Leg bestPath;
+    /*
+     * When asked for, one byte per block of frontierScale by frontierScale cells, row by row,
+     * which is 1 where the block holds a cell waiting to be expanded. Empty otherwise.
+     */
+    long frontierWidth = 0;
+    long frontierHeight = 0;
+    std::vector<uint8_t> frontier;
+    // Set on the last snapshot, published once every leg has been searched or the search has stopped
+    bool finished = false;
+};
+
+/*
+ * A channel from a search to one reader which only ever holds the newest snapshot.
+ * The search publishes every interval expansions; publishing never waits on the reader
+ * and reading never waits on the search, as each swaps buffers with one atomic exchange.
+ * A search given no channel skips all of this, so nobody pays for progress they do not read.
+ */
+class SearchProgress
+{
+public:
+    // frontierScale is the side of each frontier mask block in cells, or 0 for no mask
+    explicit SearchProgress(long interval = 65536, long frontierScale = 0)
+        : every(interval > 0 ? interval : 1), scale(frontierScale)
+    {}
+
+    long interval() const { return every; }
+    long frontierScale() const { return scale; }
+
+    // Only the search may call this
+    void publish(SearchSnapshot snapshot);
+
+    // Only the reader may call this. Returns false if nothing was published since the last read.
+    bool read(SearchSnapshot &snapshot);
+
+private:
+    static constexpr int indexMask = 3;
+    // Marks the middle buffer as holding a snapshot the reader has not taken
+    static constexpr int fresh = 4;
+
+    long every;
+    long scale;
+
+    SearchSnapshot buffers[3];
+    // Owned by the search
+    int back = 0;
+    // Owned by the reader
+    int front = 1;
+    // The buffer passed between them, with the fresh bit
+    std::atomic<int> middle{2};
+};
+
+#endif //BREADCRUMBS_SEARCHPROGRESS_H
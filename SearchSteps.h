@@ -0,0 +1,130 @@
+//
+// The cost model and neighbourhood of a single search step.
+//
+
+#ifndef BREADCRUMBS_SEARCHSTEPS_H
+#define BREADCRUMBS_SEARCHSTEPS_H
+
+#include <vector>
+#include <queue>
+#include <cmath>
+#include <algorithm>
+#include "breadcrumbs.h"
+
+/*
+ * Every search runs these for each cell it expands, so they live in a header
+ * to be inlined into the searches in breadcrumbs.cpp and measured on their own
+ * by the benchmarks.
+ */
+
+template <typename Raster>
+inline bool inBounds(const Raster &matrix, const MatrixPoint &p)
+{
+    return (p.x > -1 && p.y > -1) && p.y < rasterHeight(matrix) && p.x < rasterWidth(matrix);
+}
+
+template <typename Raster>
+inline void getSurroundingPoints(const Raster &matrix, const MatrixPoint &currentPoint, std::vector<MatrixPoint> &surroundingPoints)
+{
+    auto stepSize = 1;
+
+    auto writeIndex = 0;
+    for (long x = currentPoint.x - stepSize; x <= currentPoint.x + stepSize; x += stepSize)
+    {
+        for (long y = currentPoint.y - stepSize; y <= currentPoint.y + stepSize; y += stepSize)
+        {
+            if(!(x == currentPoint.x && y == currentPoint.y) && inBounds(matrix, {x, y}))
+            {
+                surroundingPoints[writeIndex].x = x;
+                surroundingPoints[writeIndex].y = y;
+                surroundingPoints[writeIndex].movementCost = 0;
+                surroundingPoints[writeIndex].totalCost = 0;
+                ++writeIndex;
+            }
+        }
+    }
+
+    surroundingPoints.resize(writeIndex);
+}
+
+inline double distance(const MatrixPoint &a, const MatrixPoint &b, double height = 0, double xScale = 1, double yScale = 1, double zScale = 1)
+{
+    auto xScaled = (double)(b.x - a.x) * xScale;
+    auto yScaled = (double)(b.y - a.y) * yScale;
+    auto zScaled = height * zScale;
+
+    return std::sqrt(xScaled*xScaled + yScaled*yScaled + zScaled*zScaled);
+}
+
+template <typename Raster>
+inline double scaledHeight(const Raster &matrix, const MatrixPoint &a, const MatrixPoint &b, const double &unitsPerPixel)
+{
+    double scaleFactor = 1 / unitsPerPixel;
+    return std::abs(rasterAt(matrix, b.x, b.y) - rasterAt(matrix, a.x, a.y)) * scaleFactor;
+}
+
+template <typename Raster>
+inline double gradeCost(const MatrixPoint &currentPoint, const MatrixPoint &successor, const Raster &matrix, const Weights &weights)
+{
+    long x = currentPoint.x;
+    long y = currentPoint.y;
+    const long xDiff = successor.x - currentPoint.x;
+    const long yDiff = successor.y - currentPoint.y;
+
+    double worstHeight = 0;
+
+    const unsigned int radius = weights.gradeRadius;
+    for (auto i = 0u; i < radius; ++i)
+    {
+        if (inBounds(matrix, {x + xDiff, y + yDiff}) && inBounds(matrix, {x, y}))
+        {
+            worstHeight = std::max(worstHeight,
+                                   scaledHeight(matrix, {x, y}, {x + xDiff, y + yDiff}, weights.unitsPerPixel));
+        }
+
+        x += xDiff;
+        y += yDiff;
+    }
+
+    return std::pow(weights.gradeBase, worstHeight / distance(currentPoint, successor));
+}
+
+/*
+ * The cost of moving between two neighbouring cells, before the cost layers:
+ * the weighted 3D distance plus the grade cost looking ahead from the first.
+ */
+template <typename Raster>
+inline double stepCost(const Raster &elevationMatrix, const MatrixPoint &from, const MatrixPoint &to, const Weights &weights)
+{
+    double heightToSuccessor = scaledHeight(
+            elevationMatrix,
+            from,
+            to,
+            weights.unitsPerPixel
+    );
+
+    return distance(
+                from,
+                to,
+                heightToSuccessor,
+                weights.movementCostXY,
+                weights.movementCostXY,
+                weights.movementCostZ
+            )
+          + gradeCost(
+                    from,
+                    to,
+                    elevationMatrix,
+                    weights
+            );
+}
+
+// Orders the open list of getShortestPath by lowest estimated total cost first
+struct TotalCostGreater
+{
+    bool operator()(const MatrixPoint &a, const MatrixPoint &b) const { return a.totalCost > b.totalCost; }
+};
+
+using PointQueue = std::priority_queue<MatrixPoint, std::vector<MatrixPoint>, TotalCostGreater>;
+
+#endif //BREADCRUMBS_SEARCHSTEPS_H
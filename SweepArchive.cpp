@@ -0,0 +1,416 @@
+//
+// Single-file storage for the routes of a parameter sweep.
+//
+
+#include <sstream>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+#include <unistd.h>
+#include "zlib.h"
+#include "SweepArchive.h"
+#include "PathOps.h"
+
+using std::vector;
+using std::string;
+using std::unique_ptr;
+
+// Opens and closes every packed sweep archive
+const char archiveMagic [] = "BCSWEEP2";
+const size_t magicBytes = 8;
+
+// Deflate level for each record
+const int recordLevel = 6;
+
+WeightsKey weightsKey(const Weights &weights)
+{
+    return WeightsKey(weights.unitsPerPixel, weights.gradeBase, weights.gradeRadius,
+                      weights.movementCostXY, weights.movementCostZ, weights.heuristicXY, weights.heuristicZ);
+}
+
+/*
+ * The shortest decimal which reads back as the same double, so runs whose weights
+ * differ in any digit never share a name.
+ */
+string exactDecimal(double value)
+{
+    char digits[32];
+    const auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    return string(digits, end);
+}
+
+string sweepRunName(const Weights &weights)
+{
+    std::ostringstream name;
+    name << "grade(" << weights.gradeBase << ", r=" << weights.gradeRadius << ")"
+         << "g(xy=" << exactDecimal(weights.movementCostXY) << ", z=" << exactDecimal(weights.movementCostZ) << ")"
+         << "h(xy=" << exactDecimal(weights.heuristicXY) << ", z=" << exactDecimal(weights.heuristicZ) << ")"
+         << "u(" << exactDecimal(weights.unitsPerPixel) << ")";
+    return name.str();
+}
+
+/*
+ * Archive fields are little endian, whatever the host.
+ */
+void putFixed(string &bytes, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        bytes.push_back((char)((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putFixed(string &bytes, double value)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    putFixed(bytes, bits);
+}
+
+uint64_t getFixed(const char *bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        value |= (uint64_t)(uint8_t)bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+double getFixedDouble(const char *bytes)
+{
+    const uint64_t bits = getFixed(bytes);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+bool SweepWriter::add(const Weights &weights, const Route &route)
+{
+    const auto fingerprint = routeFingerprint(route);
+    auto steps = encodeRouteSteps(route);
+    const auto matches = pathsByFingerprint.equal_range(fingerprint);
+    for (auto found = matches.first; found != matches.second; ++found)
+    {
+        // A different path with the same fingerprint is stored as a path of its own
+        if (pathSteps[found->second] == steps)
+        {
+            return addRun(weights, found->second);
+        }
+    }
+
+    const uint64_t path = pathSteps.size();
+    pathsByFingerprint.emplace(fingerprint, path);
+    pathSteps.push_back(std::move(steps));
+    pathsByWeights[weightsKey(weights)] = path;
+    runs.push_back({weights, path});
+
+    return writePath(path, weights, route);
+}
+
+bool SweepWriter::addSameAs(const Weights &weights, const Weights &earlier)
+{
+    auto found = pathsByWeights.find(weightsKey(earlier));
+    return found != pathsByWeights.end() && addRun(weights, found->second);
+}
+
+bool SweepWriter::addRun(const Weights &weights, uint64_t path)
+{
+    pathsByWeights[weightsKey(weights)] = path;
+    runs.push_back({weights, path});
+
+    return writeRepeat(runs.back());
+}
+
+/*
+ * Writes the table of runs as CSV, one row of weights and path ID per run.
+ * Throws std::runtime_error if it cannot be written.
+ */
+void writeRunsCSV(const string &filename, const vector<SweepRun> &runs)
+{
+    std::ofstream out(filename);
+    out << "unitsPerPixel,gradeBase,gradeRadius,movementCostXY,movementCostZ,heuristicXY,heuristicZ,path" << '\n';
+    for (const auto &run : runs)
+    {
+        const auto &w = run.weights;
+        out << exactDecimal(w.unitsPerPixel) << ',' << w.gradeBase << ',' << w.gradeRadius << ','
+            << exactDecimal(w.movementCostXY) << ',' << exactDecimal(w.movementCostZ) << ','
+            << exactDecimal(w.heuristicXY) << ',' << exactDecimal(w.heuristicZ) << ',' << run.path << '\n';
+    }
+
+    out.flush();
+    if (!out)
+    {
+        throw std::runtime_error("Unable to write the table of runs to " + filename);
+    }
+}
+
+SweepDirectoryWriter::SweepDirectoryWriter(const string &directory, long width, long height,
+                                           TiffCompression compression)
+    : directory(directory), width(width), height(height), compression(compression)
+{}
+
+void SweepDirectoryWriter::finish()
+{
+    writeRunsCSV(directory + "runs.csv", runs);
+}
+
+bool SweepDirectoryWriter::writePath(uint64_t, const Weights &weights, const Route &route)
+{
+    // Never write through a link left by an earlier sweep into this directory
+    pathFiles.push_back(directory + sweepRunName(weights) + ".tif");
+    std::remove(pathFiles.back().data());
+    writeRouteToTIFF(route, width, height, pathFiles.back(), compression);
+    return true;
+}
+
+bool SweepDirectoryWriter::writeRepeat(const SweepRun &run)
+{
+    const string filename = directory + sweepRunName(run.weights) + ".tif";
+    const string &original = pathFiles[run.path];
+    if (filename == original)
+    {
+        return true;
+    }
+
+    // Links are not supported everywhere, so fall back to a copy
+    std::remove(filename.data());
+    if (link(original.data(), filename.data()) == 0)
+    {
+        return true;
+    }
+
+    std::error_code error;
+    return std::filesystem::copy_file(original, filename, error);
+}
+
+SweepArchiveWriter::SweepArchiveWriter(const string &filename, long width, long height)
+    : filename(filename), temporary(filename + ".tmp"), file(temporary, std::ios::binary | std::ios::trunc)
+{
+    if (!file)
+    {
+        throw std::runtime_error("Unable to create sweep archive " + filename);
+    }
+
+    string header(archiveMagic, magicBytes);
+    putFixed(header, (uint64_t)width);
+    putFixed(header, (uint64_t)height);
+    file.write(header.data(), header.size());
+}
+
+SweepArchiveWriter::~SweepArchiveWriter()
+{
+    if (!finished)
+    {
+        file.close();
+        std::remove(temporary.data());
+    }
+}
+
+void SweepArchiveWriter::finish()
+{
+    const uint64_t indexOffset = file.tellp();
+
+    string bytes;
+    putFixed(bytes, (uint64_t)paths.size());
+    for (const auto &record : paths)
+    {
+        putFixed(bytes, record.offset);
+        putFixed(bytes, record.bytes);
+        putFixed(bytes, record.rawBytes);
+    }
+
+    putFixed(bytes, (uint64_t)runs.size());
+    for (const auto &run : runs)
+    {
+        putFixed(bytes, run.weights.unitsPerPixel);
+        putFixed(bytes, (uint64_t)(int64_t)run.weights.gradeBase);
+        putFixed(bytes, (uint64_t)(int64_t)run.weights.gradeRadius);
+        putFixed(bytes, run.weights.movementCostXY);
+        putFixed(bytes, run.weights.movementCostZ);
+        putFixed(bytes, run.weights.heuristicXY);
+        putFixed(bytes, run.weights.heuristicZ);
+        putFixed(bytes, run.path);
+    }
+
+    putFixed(bytes, indexOffset);
+    bytes.append(archiveMagic, magicBytes);
+    file.write(bytes.data(), bytes.size());
+    file.close();
+    if (!file)
+    {
+        throw std::runtime_error("Unable to write sweep archive " + filename);
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, filename, error);
+    if (error)
+    {
+        throw std::runtime_error("Unable to write sweep archive " + filename + ": " + error.message());
+    }
+    finished = true;
+}
+
+bool SweepArchiveWriter::writePath(uint64_t, const Weights &, const Route &route)
+{
+    const auto raw = encodeRouteSteps(route);
+    uLongf encodedBytes = compressBound(raw.size());
+    vector<uint8_t> encoded(encodedBytes);
+    compress2(encoded.data(), &encodedBytes, raw.data(), raw.size(), recordLevel);
+
+    const uint64_t offset = file.tellp();
+    file.write(reinterpret_cast<const char *>(encoded.data()), encodedBytes);
+    paths.push_back({offset, encodedBytes, raw.size()});
+
+    return (bool)file;
+}
+
+// Sizes of one entry in the index of paths and the table of runs
+const size_t pathEntryBytes = 3 * 8;
+const size_t runEntryBytes = 8 * 8;
+
+SweepArchive::SweepArchive(const string &filename)
+    : file(filename, std::ios::binary)
+{
+    const string invalid = "Not a complete sweep archive: " + filename;
+    char header[magicBytes + 16];
+    char footer[8 + magicBytes];
+    if (!file.read(header, sizeof(header)) || std::memcmp(header, archiveMagic, magicBytes) != 0 ||
+        !file.seekg(-(long)sizeof(footer), std::ios::end) || !file.read(footer, sizeof(footer)) ||
+        std::memcmp(footer + 8, archiveMagic, magicBytes) != 0)
+    {
+        throw std::runtime_error(invalid);
+    }
+
+    columns = (long)getFixed(header + magicBytes);
+    rows = (long)getFixed(header + magicBytes + 8);
+
+    // Reads a count followed by that many entries of entryBytes
+    auto readTable = [this, &invalid](size_t entryBytes)
+    {
+        char countBytes[8];
+        if (!file.read(countBytes, sizeof(countBytes)))
+        {
+            throw std::runtime_error(invalid);
+        }
+
+        string entries(getFixed(countBytes) * entryBytes, '\0');
+        if (!file.read(&entries[0], entries.size()))
+        {
+            throw std::runtime_error(invalid);
+        }
+        return entries;
+    };
+
+    file.seekg(getFixed(footer));
+    const string pathEntries = readTable(pathEntryBytes);
+    for (size_t i = 0; i < pathEntries.size(); i += pathEntryBytes)
+    {
+        const char *entry = pathEntries.data() + i;
+        paths.push_back({getFixed(entry), getFixed(entry + 8), getFixed(entry + 16)});
+    }
+
+    const string runEntries = readTable(runEntryBytes);
+    for (size_t i = 0; i < runEntries.size(); i += runEntryBytes)
+    {
+        const char *entry = runEntries.data() + i;
+        SweepRun run;
+        run.weights = {
+                getFixedDouble(entry),
+                (int)(int64_t)getFixed(entry + 8),
+                (int)(int64_t)getFixed(entry + 16),
+                getFixedDouble(entry + 24),
+                getFixedDouble(entry + 32),
+                getFixedDouble(entry + 40),
+                getFixedDouble(entry + 48)
+        };
+        run.path = getFixed(entry + 56);
+        if (run.path >= paths.size())
+        {
+            throw std::runtime_error(invalid);
+        }
+
+        byWeights[weightsKey(run.weights)] = run.path;
+        runTable.push_back(run);
+    }
+}
+
+Route SweepArchive::path(uint64_t id)
+{
+    const auto &record = paths.at(id);
+    vector<uint8_t> encoded(record.bytes);
+    file.clear();
+    file.seekg(record.offset);
+    file.read(reinterpret_cast<char *>(encoded.data()), encoded.size());
+
+    vector<uint8_t> raw(record.rawBytes);
+    uLongf rawBytes = raw.size();
+    if (!file || uncompress(raw.data(), &rawBytes, encoded.data(), encoded.size()) != Z_OK)
+    {
+        throw std::runtime_error("Corrupt sweep archive path " + std::to_string(id));
+    }
+
+    return decodeRouteSteps(raw);
+}
+
+bool SweepArchive::find(const Weights &weights, Route &route)
+{
+    auto found = byWeights.find(weightsKey(weights));
+    if (found == byWeights.end())
+    {
+        return false;
+    }
+
+    route = path(found->second);
+    return true;
+}
+
+/*
+ * Pages of a multi-page TIFF, one per distinct path, named after the first run
+ * which took it. The table of runs is written beside it as CSV.
+ */
+class SweepPagesWriter : public SweepWriter
+{
+public:
+    SweepPagesWriter(const string &filename, long width, long height, TiffCompression compression)
+        : pages(filename, width, height, compression), tableFilename(filename.substr(0, filename.find_last_of('.')) + ".csv")
+    {
+        if (!pages.isOpen())
+        {
+            throw std::runtime_error("Unable to create sweep TIFF " + filename);
+        }
+    }
+
+    void finish() override
+    {
+        writeRunsCSV(tableFilename, runs);
+    }
+
+protected:
+    bool writePath(uint64_t, const Weights &weights, const Route &route) override
+    {
+        return pages.addRoute(route, sweepRunName(weights));
+    }
+
+private:
+    RoutePagesTIFF pages;
+    string tableFilename;
+};
+
+unique_ptr<SweepWriter> openSweepWriter(const string &filename, long width, long height, TiffCompression compression)
+{
+    auto endsWith = [&filename](const string &extension)
+    {
+        return filename.size() >= extension.size()
+            && filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+    };
+
+    if (endsWith(".tif") || endsWith(".tiff"))
+    {
+        return std::make_unique<SweepPagesWriter>(filename, width, height, compression);
+    }
+
+    return std::make_unique<SweepArchiveWriter>(filename, width, height);
+}
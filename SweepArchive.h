@@ -0,0 +1,189 @@
+//
+// Single-file storage for the routes of a parameter sweep.
+//
+
+#ifndef BREADCRUMBS_SWEEPARCHIVE_H
+#define BREADCRUMBS_SWEEPARCHIVE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+#include "breadcrumbs.h"
+#include "TiffOps.h"
+
+// Orders Weights so they can key an index
+using WeightsKey = std::tuple<double, int, int, double, double, double, double>;
+WeightsKey weightsKey(const Weights &weights);
+
+/*
+ * Names a run after every one of its weights, e.g. "grade(10, r=5)g(xy=1, z=0)h(xy=10, z=1)u(1)",
+ * writing each exactly, so that runs with different weights never share a name.
+ */
+std::string sweepRunName(const Weights &weights);
+
+// One run of a sweep and the distinct path it took
+struct SweepRun
+{
+    Weights weights;
+    uint64_t path;
+};
+
+/*
+ * Receives every run of a sweep as it completes.
+ * Routes are fingerprinted so each distinct path is stored once, however many
+ * runs take it, and each run is mapped to the ID of its path. Paths are
+ * numbered from 0 in the order they are first seen. Each distinct path's steps
+ * are kept, about two bytes a cell, so a route whose fingerprint matches is
+ * only taken as a repeat if its steps match too.
+ */
+class SweepWriter
+{
+public:
+    virtual ~SweepWriter() = default;
+
+    // Returns false if the run could not be written
+    bool add(const Weights &weights, const Route &route);
+
+    /*
+     * Records a run which was not searched because an earlier run with the
+     * same canonical weights already was. Returns false if there was no such run.
+     */
+    bool addSameAs(const Weights &weights, const Weights &earlier);
+
+    /*
+     * Writes whatever follows the last run, such as an archive's index or the table of runs.
+     * Nothing is complete until this is called.
+     * Throws std::runtime_error if it cannot be written.
+     */
+    virtual void finish() {}
+
+    size_t runCount() const { return runs.size(); }
+    size_t pathCount() const { return pathSteps.size(); }
+
+protected:
+    // Stores a path seen for the first time, in the run with these weights
+    virtual bool writePath(uint64_t path, const Weights &weights, const Route &route) = 0;
+
+    // Stores a run whose path was already written
+    virtual bool writeRepeat(const SweepRun &) { return true; }
+
+    std::vector<SweepRun> runs;
+
+private:
+    bool addRun(const Weights &weights, uint64_t path);
+
+    std::unordered_multimap<uint64_t, uint64_t> pathsByFingerprint;
+    std::vector<std::vector<uint8_t>> pathSteps;
+    std::map<WeightsKey, uint64_t> pathsByWeights;
+};
+
+/*
+ * Opens a single file for every run of a sweep over a width by height raster.
+ * .tif and .tiff files get one path raster page per distinct path, with the
+ * table of runs beside them in a .csv of the same name.
+ * Anything else is a packed sweep archive, which SweepArchive reads.
+ * Throws std::runtime_error if the file cannot be created.
+ */
+std::unique_ptr<SweepWriter> openSweepWriter(const std::string &filename, long width, long height,
+                                             TiffCompression compression = TiffCompression::Deflate);
+
+/*
+ * Writes each run to its own TIFF in a directory, named after its weights.
+ * Runs repeating an earlier path are hard links to its TIFF rather than copies.
+ * The table of runs is written to runs.csv in the same directory.
+ */
+class SweepDirectoryWriter : public SweepWriter
+{
+public:
+    SweepDirectoryWriter(const std::string &directory, long width, long height,
+                         TiffCompression compression = TiffCompression::Deflate);
+
+    void finish() override;
+
+protected:
+    bool writePath(uint64_t path, const Weights &weights, const Route &route) override;
+    bool writeRepeat(const SweepRun &run) override;
+
+private:
+    std::string directory;
+    long width;
+    long height;
+    TiffCompression compression;
+    std::vector<std::string> pathFiles;
+};
+
+/*
+ * A packed sweep archive holds each distinct path as a compressed list of cell steps,
+ * appended as it is first seen, followed by an index of paths and a table of runs
+ * which finish writes. A sweep of 1024 runs over a large raster fits in a few hundred
+ * kilobytes, and any run can be read back with one seek.
+ * The archive is written to a temporary file beside it and renamed into place by finish,
+ * so a sweep which fails or is killed never leaves an archive without an index.
+ */
+class SweepArchiveWriter : public SweepWriter
+{
+public:
+    // Throws std::runtime_error if the file cannot be created
+    SweepArchiveWriter(const std::string &filename, long width, long height);
+    // Removes the temporary file if the archive was never finished
+    ~SweepArchiveWriter() override;
+
+    void finish() override;
+
+    // Where a path's record lies in the archive
+    struct Record
+    {
+        uint64_t offset;
+        uint64_t bytes;
+        uint64_t rawBytes;
+    };
+
+protected:
+    bool writePath(uint64_t path, const Weights &weights, const Route &route) override;
+
+private:
+    std::string filename;
+    std::string temporary;
+    std::ofstream file;
+    bool finished = false;
+    std::vector<Record> paths;
+};
+
+/*
+ * Reads a packed sweep archive. Only the index is read on opening; each route
+ * is read and decoded when asked for.
+ * Throws std::runtime_error if the file is not a complete sweep archive.
+ */
+class SweepArchive
+{
+public:
+    explicit SweepArchive(const std::string &filename);
+
+    long width() const { return columns; }
+    long height() const { return rows; }
+
+    // Every run and its path ID, in the order they were written
+    const std::vector<SweepRun> &runs() const { return runTable; }
+    size_t pathCount() const { return paths.size(); }
+
+    // Reads a distinct path by its ID
+    Route path(uint64_t id);
+
+    // Reads the route of the run with these weights. Returns false if there was no such run.
+    bool find(const Weights &weights, Route &route);
+
+private:
+    std::ifstream file;
+    long columns = 0;
+    long rows = 0;
+    std::vector<SweepArchiveWriter::Record> paths;
+    std::vector<SweepRun> runTable;
+    std::map<WeightsKey, uint64_t> byWeights;
+};
+
+#endif //BREADCRUMBS_SWEEPARCHIVE_H
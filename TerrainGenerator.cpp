@@ -0,0 +1,168 @@
+//
+// Synthetic terrains of any size, for benchmarking without fixtures.
+//
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include "TerrainGenerator.h"
+#include "ThreadPool.h"
+
+using std::vector;
+
+// splitmix64's finalizer, which scatters nearby inputs across all 64 bits
+uint64_t mixBits(uint64_t z)
+{
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// One of eight unit gradients, chosen by a lattice point's hash
+struct Gradient
+{
+    float x;
+    float y;
+};
+
+Gradient latticeGradient(uint64_t octaveSeed, long ix, long iy)
+{
+    static const Gradient gradients[] = {{1, 0}, {0.70710678f, 0.70710678f}, {0, 1}, {-0.70710678f, 0.70710678f},
+                                         {-1, 0}, {-0.70710678f, -0.70710678f}, {0, -1}, {0.70710678f, -0.70710678f}};
+    return gradients[mixBits(mixBits(octaveSeed ^ (uint64_t)ix) ^ (uint64_t)iy) >> 61];
+}
+
+// Perlin's quintic, which makes the noise's slope continuous across lattice cells
+inline float fade(float t)
+{
+    return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+/*
+ * Adds one octave of gradient noise along a row, scaled by amplitude. The row is
+ * walked one lattice cell at a time, so the gradients are looked up once per lattice
+ * cell rather than once per cell, and the loop over the cells within has no branches.
+ */
+void addOctave(float *row, long width, double fieldX, double fieldY, double frequency, float amplitude,
+               uint64_t octaveSeed)
+{
+    const double v = fieldY * frequency;
+    const long iy = (long)std::floor(v);
+    const float fy = (float)(v - iy);
+    const float sy = fade(fy);
+
+    auto latticeX = [&](long x) { return (long)std::floor((fieldX + x) * frequency); };
+
+    long x = 0;
+    while (x < width)
+    {
+        const long ix = latticeX(x);
+        // The first cell past this lattice cell, estimated and then made exact
+        long end = std::min(width, std::max(x + 1, (long)std::ceil((ix + 1) / frequency - fieldX)));
+        while (end > x + 1 && latticeX(end - 1) > ix)
+        {
+            --end;
+        }
+        while (end < width && latticeX(end) == ix)
+        {
+            ++end;
+        }
+
+        const Gradient g00 = latticeGradient(octaveSeed, ix, iy);
+        const Gradient g10 = latticeGradient(octaveSeed, ix + 1, iy);
+        const Gradient g01 = latticeGradient(octaveSeed, ix, iy + 1);
+        const Gradient g11 = latticeGradient(octaveSeed, ix + 1, iy + 1);
+        // The parts of each corner's dot product which do not change along the row
+        const float c00 = g00.y * fy;
+        const float c10 = g10.y * fy - g10.x;
+        const float c01 = g01.y * (fy - 1);
+        const float c11 = g11.y * (fy - 1) - g11.x;
+        const float first = (float)((fieldX + x) * frequency - ix);
+        const float step = (float)frequency;
+
+        float *cells = row + x;
+        const int count = (int)(end - x);
+        for (int i = 0; i < count; ++i)
+        {
+            const float fx = first + (float)i * step;
+            const float n00 = c00 + g00.x * fx;
+            const float n10 = c10 + g10.x * fx;
+            const float n01 = c01 + g01.x * fx;
+            const float n11 = c11 + g11.x * fx;
+            const float sx = fade(fx);
+            const float top = n00 + sx * (n10 - n00);
+            const float bottom = n01 + sx * (n11 - n01);
+            cells[i] += amplitude * (top + sy * (bottom - top));
+        }
+        x = end;
+    }
+}
+
+/*
+ * The field's noise over the settings' window, row by row, scaled so it mostly lies
+ * within -1 to 1, then passed through finish cell by cell.
+ */
+template <typename Finish>
+vector<float> generateField(const TerrainSettings &settings, uint64_t seed, ThreadPool &pool, Finish finish)
+{
+    const long width = settings.width;
+    vector<float> cells(width * settings.height);
+
+    // Octave seeds, and offsets so the octaves' lattices do not line up at the field's origin
+    vector<uint64_t> octaveSeeds(settings.octaves);
+    vector<double> offsets(settings.octaves);
+    double amplitudeSum = 0;
+    for (int octave = 0; octave < settings.octaves; ++octave)
+    {
+        octaveSeeds[octave] = mixBits(seed + (uint64_t)octave);
+        offsets[octave] = (double)(mixBits(octaveSeeds[octave]) >> 40) / (1 << 16);
+        amplitudeSum += std::pow(settings.persistence, octave);
+    }
+    // Gradient noise rarely strays beyond a third of its sum's amplitude
+    const float scale = (float)(3 / amplitudeSum);
+
+    pool.parallelFor(0, settings.height, [&](long firstRow, long lastRow)
+    {
+        for (long y = firstRow; y < lastRow; ++y)
+        {
+            float *row = cells.data() + y * width;
+            double frequency = 1 / settings.featureSize;
+            float amplitude = scale;
+            for (int octave = 0; octave < settings.octaves; ++octave)
+            {
+                addOctave(row, width, settings.originX + offsets[octave] / frequency,
+                          settings.originY + y + offsets[octave] / frequency, frequency, amplitude, octaveSeeds[octave]);
+                frequency *= 2;
+                amplitude *= (float)settings.persistence;
+            }
+            for (long x = 0; x < width; ++x)
+            {
+                row[x] = finish(std::min(1.0f, std::max(-1.0f, row[x])));
+            }
+        }
+    });
+
+    return cells;
+}
+
+vector<float> generateElevation(const TerrainSettings &settings, ThreadPool &pool)
+{
+    const float relief = settings.relief;
+    return generateField(settings, settings.seed, pool, [relief](float noise)
+    {
+        return relief * (noise + 1) / 2;
+    });
+}
+
+vector<float> generateCostLayer(const TerrainSettings &settings, int classes, ThreadPool &pool)
+{
+    // Three octaves give patches with ragged edges but no speckle
+    TerrainSettings patches = settings;
+    patches.octaves = std::min(settings.octaves, 3);
+    const float top = (float)std::max(classes - 1, 0);
+    return generateField(patches, mixBits(settings.seed ^ 0x636f73744c61796bULL), pool, [classes, top](float noise)
+    {
+        return std::min(top, std::floor((noise + 1) / 2 * classes));
+    });
+}
@@ -0,0 +1,49 @@
+//
+// Synthetic terrains of any size, for benchmarking without fixtures.
+//
+
+#ifndef BREADCRUMBS_TERRAINGENERATOR_H
+#define BREADCRUMBS_TERRAINGENERATOR_H
+
+#include <vector>
+#include <cstdint>
+
+class ThreadPool;
+
+/*
+ * A width by height window onto an endless field of multi-octave gradient noise
+ * (fractional Brownian motion). Every cell depends only on the seed and its position
+ * in the field, so the same settings give the same raster on any number of threads,
+ * and windows of different sizes agree wherever they overlap.
+ */
+struct TerrainSettings
+{
+    long width = 0;
+    long height = 0;
+    uint64_t seed = 1;
+    // The position in the field of the window's top left cell
+    long originX = 0;
+    long originY = 0;
+    // The size in cells of the broadest features. Each octave after the first halves it.
+    double featureSize = 1024;
+    int octaves = 8;
+    // How much of the last octave's amplitude each octave keeps
+    double persistence = 0.5;
+    // Heights span 0 to about this, in the units unitsPerPixel converts cells to
+    float relief = 600;
+};
+
+/*
+ * An elevation raster, row by row, with steps between cells about as steep
+ * as the gallery's DEMs at the default settings.
+ */
+std::vector<float> generateElevation(const TerrainSettings & settings, ThreadPool & pool);
+
+/*
+ * A cost layer to match, row by row: patches of whole numbers from 0 to classes - 1,
+ * as in a land cover raster, drawn from the field with a different seed.
+ * The patches are as broad as settings' features.
+ */
+std::vector<float> generateCostLayer(const TerrainSettings & settings, int classes, ThreadPool & pool);
+
+#endif //BREADCRUMBS_TERRAINGENERATOR_H
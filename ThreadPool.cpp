@@ -0,0 +1,101 @@
+//
+// A fixed set of worker threads shared by the parallel kernels.
+//
+
+#include <algorithm>
+#include "ThreadPool.h"
+
+using std::vector;
+using std::future;
+using std::function;
+using std::packaged_task;
+using std::lock_guard;
+using std::unique_lock;
+using std::mutex;
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned i = 0; i < threads; ++i)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(tasksMutex);
+        stopping = true;
+    }
+    tasksReady.notify_all();
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+future<void> ThreadPool::submit(function<void()> task)
+{
+    packaged_task<void()> packaged(std::move(task));
+    auto result = packaged.get_future();
+    {
+        lock_guard<mutex> lock(tasksMutex);
+        tasks.push_back(std::move(packaged));
+    }
+    tasksReady.notify_one();
+
+    return result;
+}
+
+void ThreadPool::parallelFor(long begin, long end, const function<void(long, long)> &body)
+{
+    const long count = end - begin;
+    if (count <= 0)
+    {
+        return;
+    }
+
+    const long chunks = std::min<long>(count, size());
+    const long chunkSize = (count + chunks - 1) / chunks;
+
+    vector<future<void>> pending;
+    for (long chunkBegin = begin + chunkSize; chunkBegin < end; chunkBegin += chunkSize)
+    {
+        const long chunkEnd = std::min(end, chunkBegin + chunkSize);
+        pending.push_back(submit([&body, chunkBegin, chunkEnd] { body(chunkBegin, chunkEnd); }));
+    }
+
+    body(begin, std::min(end, begin + chunkSize));
+
+    for (auto &chunk : pending)
+    {
+        chunk.get();
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        packaged_task<void()> task;
+        {
+            unique_lock<mutex> lock(tasksMutex);
+            tasksReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty())
+            {
+                return;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,54 @@
+//
+// A fixed set of worker threads shared by the parallel kernels.
+//
+
+#ifndef BREADCRUMBS_THREADPOOL_H
+#define BREADCRUMBS_THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+/*
+ * Runs submitted tasks on a fixed number of threads.
+ * A pool of one thread still runs tasks on that thread, so callers
+ * never need a separate single-threaded path.
+ */
+class ThreadPool
+{
+public:
+    // Zero threads means one per hardware thread
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const { return workers.size(); }
+
+    // Queues a task, returning a future which is ready when it has run
+    std::future<void> submit(std::function<void()> task);
+
+    /*
+     * Splits [begin, end) into roughly equal chunks, one per thread,
+     * calls body(chunkBegin, chunkEnd) for each, and waits for them all.
+     * The calling thread runs the first chunk itself.
+     * Must not be called from one of the pool's own tasks.
+     */
+    void parallelFor(long begin, long end, const std::function<void(long, long)> &body);
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::packaged_task<void()>> tasks;
+    std::mutex tasksMutex;
+    std::condition_variable tasksReady;
+    bool stopping = false;
+};
+
+#endif //BREADCRUMBS_THREADPOOL_H
@@ -5,13 +5,80 @@
 #include <string>
 #include <cstring>
 #include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <memory>
+#include "zlib.h"
 #include "tiffio.h"
+#include "TiffOps.h"
+#include "PathOps.h"
+#include "ThreadPool.h"
 
 using std::vector;
 using std::string;
 using std::cout;
 using std::endl;
 
+// Cells in each band of scanlines read from a stripped TIFF
+const uint32 bandCells = 64 * 1024;
+
+/*
+ * Calls visit(x, y, width, length, cells, stride) for each tile of a tiled TIFF,
+ * or each band of scanlines of a stripped one, in turn, with cells of type Sample.
+ * Only one tile or band of the image is held in memory at a time.
+ */
+template <typename Sample = float, typename Visitor>
+void visitTIFF(TIFF *tiff, Visitor visit)
+{
+    uint32 imageWidth, imageLength;
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &imageWidth);
+    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &imageLength);
+    tdata_t buf;
+
+    if (TIFFIsTiled(tiff))
+    {
+        uint32 tileWidth, tileLength;
+        uint32 x, y;
+
+        TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tileWidth);
+        TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tileLength);
+        buf = _TIFFmalloc(TIFFTileSize(tiff));
+        for (y = 0; y < imageLength; y += tileLength)
+        {
+            for (x = 0; x < imageWidth; x += tileWidth)
+            {
+                TIFFReadTile(tiff, buf, x, y, 0, 0);
+                visit(x, y,
+                      std::min(tileWidth, imageWidth - x),
+                      std::min(tileLength, imageLength - y),
+                      (const Sample *) buf,
+                      tileWidth);
+            }
+        }
+    }
+    else
+    {
+        // Scanlines are gathered into bands so each visit has enough cells to split between threads
+        const uint32 bandLength = std::max(1u, bandCells / imageWidth);
+        const tmsize_t scanlineSize = TIFFScanlineSize(tiff);
+        buf = _TIFFmalloc(scanlineSize * bandLength);
+        for (uint32 bandRow = 0; bandRow < imageLength; bandRow += bandLength)
+        {
+            const uint32 rows = std::min(bandLength, imageLength - bandRow);
+            for (uint32 row = 0; row < rows; ++row)
+            {
+                TIFFReadScanline(tiff, (char *) buf + row * scanlineSize, bandRow + row, 0);
+            }
+            visit(0u, bandRow, imageWidth, rows, (const Sample *) buf, imageWidth);
+        }
+    }
+
+    _TIFFfree(buf);
+}
+
 vector<vector<float>> readTIFF(const string &filename)
 {
     TIFFSetWarningHandler(nullptr);
@@ -23,137 +90,501 @@ vector<vector<float>> readTIFF(const string &filename)
         TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &imageWidth);
         TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &imageLength);
         matrix = vector<vector<float>>(imageLength, vector<float>(imageWidth));
-        tdata_t buf;
 
-        if (TIFFIsTiled(tiff))
+        visitTIFF(tiff, [&matrix](uint32 x, uint32 y, uint32 width, uint32 length, const float *cells, uint32 stride)
         {
-            uint32 tileWidth, tileLength;
-            uint32 x, y;
-
-            TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tileWidth);
-            TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tileLength);
-            buf = _TIFFmalloc(TIFFTileSize(tiff));
-            for (y = 0; y < imageLength; y += tileLength)
+            for (uint32 row = 0; row < length; ++row)
             {
-                for (x = 0; x < imageWidth; x += tileWidth)
-                {
-                    TIFFReadTile(tiff, buf, x, y, 0, 0);
-                    for (auto tileY = y; tileY < y + tileLength && tileY < imageLength; ++tileY)
-                    {
-                        for (auto tileX = x; tileX < x + tileWidth && tileX < imageWidth; ++tileX)
-                        {
-                            matrix[tileY][tileX] = ((float *) buf)[tileX - x + (tileY - y) * tileWidth];
-                        }
-                    }
-                }
+                std::copy(cells + row * stride, cells + row * stride + width, matrix[y + row].begin() + x);
             }
+        });
+
+        TIFFClose(tiff);
+    }
+
+    return matrix;
+}
+
+bool streamTIFF(const string &filename, long width, long height, const TileVisitor &visit)
+{
+    TIFFSetWarningHandler(nullptr);
+    TIFF * tiff = TIFFOpen(filename.data(), "r");
+    if (!tiff)
+    {
+        return false;
+    }
+
+    uint32 imageWidth, imageLength;
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &imageWidth);
+    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &imageLength);
+    if (imageWidth != width || imageLength != height)
+    {
+        TIFFClose(tiff);
+        return false;
+    }
+
+    visitTIFF(tiff, [&visit](uint32 x, uint32 y, uint32 tileWidth, uint32 tileLength, const float *cells, uint32 stride)
+    {
+        visit(x, y, tileWidth, tileLength, cells, stride);
+    });
+
+    TIFFClose(tiff);
+    return true;
+}
+
+// Edge length of the square tiles written to every output TIFF
+const long outputTileSize = 256;
+
+// Deflate level used for tiles encoded by the thread pool
+const int deflateLevel = 6;
+
+/*
+ * Threads which encode deflate tiles for every writer.
+ * Created on first use so programs which never write a TIFF do not start them.
+ */
+ThreadPool &encodingPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+bool hostIsLittleEndian()
+{
+    const uint16_t probe = 1;
+    return *reinterpret_cast<const uint8_t *>(&probe) == 1;
+}
+
+/*
+ * Applies the TIFF horizontal predictor to each row of a tile of 32-bit ints,
+ * replacing each sample with its difference from the one before.
+ */
+void applyPredictor(int32_t *tile)
+{
+    auto *samples = reinterpret_cast<uint32_t *>(tile);
+    for (long row = 0; row < outputTileSize; ++row)
+    {
+        uint32_t *rowSamples = samples + row * outputTileSize;
+        for (long i = outputTileSize - 1; i > 0; --i)
+        {
+            rowSamples[i] -= rowSamples[i - 1];
         }
-        else
+    }
+}
+
+// The horizontal predictor for a tile of bytes
+void applyPredictor(uint8_t *tile)
+{
+    for (long row = 0; row < outputTileSize; ++row)
+    {
+        uint8_t *rowSamples = tile + row * outputTileSize;
+        for (long i = outputTileSize - 1; i > 0; --i)
+        {
+            rowSamples[i] -= rowSamples[i - 1];
+        }
+    }
+}
+
+/*
+ * Applies the TIFF floating point predictor to each row of a tile of floats:
+ * the bytes of each row are regrouped from most to least significant, and each
+ * byte is then replaced with its difference from the one before.
+ */
+void applyPredictor(float *tile)
+{
+    const long rowBytes = outputTileSize * sizeof(float);
+    const bool littleEndian = hostIsLittleEndian();
+    vector<uint8_t> original(rowBytes);
+    for (long row = 0; row < outputTileSize; ++row)
+    {
+        auto *bytes = reinterpret_cast<uint8_t *>(tile + row * outputTileSize);
+        std::copy(bytes, bytes + rowBytes, original.begin());
+        for (long i = 0; i < outputTileSize; ++i)
         {
-            buf = _TIFFmalloc(TIFFScanlineSize(tiff));
-            for (uint32 imageRow = 0; imageRow < imageLength; imageRow++)
+            for (long byte = 0; byte < (long)sizeof(float); ++byte)
             {
-                TIFFReadScanline(tiff, buf, imageRow, 0);
-                for (auto i = 0; i < imageWidth; ++i)
-                {
-                    matrix[imageRow][i] = ((float *)buf)[i];
-                }
+                const long significance = littleEndian ? sizeof(float) - byte - 1 : byte;
+                bytes[significance * outputTileSize + i] = original[sizeof(float) * i + byte];
             }
         }
 
-        _TIFFfree(buf);
-        TIFFClose(tiff);
+        for (long i = rowBytes - 1; i > 0; --i)
+        {
+            bytes[i] -= bytes[i - 1];
+        }
     }
+}
 
-    return matrix;
+// Predictor and compression in one, ready for TIFFWriteRawTile
+template <typename Sample>
+vector<uint8_t> deflateTile(vector<Sample> &tile)
+{
+    applyPredictor(tile.data());
+
+    const uLong sourceBytes = tile.size() * sizeof(Sample);
+    uLongf encodedBytes = compressBound(sourceBytes);
+    vector<uint8_t> encoded(encodedBytes);
+    compress2(encoded.data(), &encodedBytes, reinterpret_cast<const Bytef *>(tile.data()), sourceBytes, deflateLevel);
+    encoded.resize(encodedBytes);
+
+    return encoded;
 }
 
-void writeMatrixToTIFF(vector<vector<float>> matrix, const string & filename)
+/*
+ * Writes a width by height image in square tiles to the current directory of out,
+ * calling fillTile(x, y, tile) for the zeroed tile whose top left cell is (x, y).
+ * fillTile returns false to leave a tile empty.
+ * Returns false if a tile could not be written.
+ *
+ * Deflate tiles are predicted and compressed in parallel by the encoding pool and
+ * written raw, with every empty tile sharing one encoding. Other compressions are
+ * encoded by libtiff as each tile is written.
+ */
+template <typename Sample>
+bool writeTiledImage(TIFF *out, long width, long height, TiffCompression compression,
+                     const std::function<bool(long, long, Sample *)> &fillTile)
 {
-    TIFF * out = TIFFOpen(filename.data(), "w");
+    if (compression == TiffCompression::ZSTD && !TIFFIsCODECConfigured(COMPRESSION_ZSTD))
+    {
+        compression = TiffCompression::Deflate;
+    }
 
-    int width = matrix[0].size();
-    int height = matrix.size();
-    int samplesPerPixel = 1;
+    const bool floatingPoint = std::is_floating_point<Sample>::value;
+    const uint16 sampleFormat = floatingPoint ? SAMPLEFORMAT_IEEEFP
+                              : std::is_signed<Sample>::value ? SAMPLEFORMAT_INT : SAMPLEFORMAT_UINT;
+    const uint16 tiffCompression [] = {COMPRESSION_NONE, COMPRESSION_LZW, COMPRESSION_ADOBE_DEFLATE, COMPRESSION_ZSTD};
 
-    TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
-    TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
-    TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, samplesPerPixel);
-    TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, 32);
+    TIFFSetField(out, TIFFTAG_IMAGEWIDTH, (uint32) width);
+    TIFFSetField(out, TIFFTAG_IMAGELENGTH, (uint32) height);
+    TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, (uint16) (8 * sizeof(Sample)));
     TIFFSetField(out, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
     TIFFSetField(out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
     TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-    TIFFSetField(out, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
+    TIFFSetField(out, TIFFTAG_SAMPLEFORMAT, sampleFormat);
+    TIFFSetField(out, TIFFTAG_TILEWIDTH, (uint32) outputTileSize);
+    TIFFSetField(out, TIFFTAG_TILELENGTH, (uint32) outputTileSize);
+    TIFFSetField(out, TIFFTAG_COMPRESSION, tiffCompression[(int) compression]);
+    if (compression != TiffCompression::None)
+    {
+        TIFFSetField(out, TIFFTAG_PREDICTOR, floatingPoint ? PREDICTOR_FLOATINGPOINT : PREDICTOR_HORIZONTAL);
+    }
 
-    size_t bytesPerLine = width * sizeof(float);
-    float * buf = nullptr;
+    const long tilesAcross = (width + outputTileSize - 1) / outputTileSize;
+    const long tileCount = tilesAcross * ((height + outputTileSize - 1) / outputTileSize);
+    const long tileCells = outputTileSize * outputTileSize;
+    auto tileOrigin = [tilesAcross](long tile)
+    {
+        return std::make_pair((tile % tilesAcross) * outputTileSize, (tile / tilesAcross) * outputTileSize);
+    };
 
-    if (TIFFScanlineSize(out))
+    if (compression == TiffCompression::Deflate)
     {
-        buf = (float *)_TIFFmalloc(bytesPerLine);
+        vector<Sample> zeros(tileCells, 0);
+        const auto emptyTile = deflateTile(zeros);
+
+        auto &pool = encodingPool();
+        const long batchSize = pool.size() * 4;
+        vector<vector<uint8_t>> encoded(batchSize);
+        // Not vector<bool>, whose packed bits cannot be written from several threads
+        vector<char> empty(batchSize);
+
+        for (long batchStart = 0; batchStart < tileCount; batchStart += batchSize)
+        {
+            const long batchEnd = std::min(tileCount, batchStart + batchSize);
+            pool.parallelFor(batchStart, batchEnd, [&](long first, long last)
+            {
+                vector<Sample> tile(tileCells);
+                for (long i = first; i < last; ++i)
+                {
+                    std::fill(tile.begin(), tile.end(), 0);
+                    const auto origin = tileOrigin(i);
+                    empty[i - batchStart] = !fillTile(origin.first, origin.second, tile.data());
+                    if (!empty[i - batchStart])
+                    {
+                        encoded[i - batchStart] = deflateTile(tile);
+                    }
+                }
+            });
+
+            for (long i = batchStart; i < batchEnd; ++i)
+            {
+                const auto &bytes = empty[i - batchStart] ? emptyTile : encoded[i - batchStart];
+                if (TIFFWriteRawTile(out, i, (void *) bytes.data(), bytes.size()) < 0)
+                {
+                    return false;
+                }
+            }
+        }
     }
     else
     {
-        buf = (float *)_TIFFmalloc(TIFFScanlineSize(out));
+        vector<Sample> tile(tileCells);
+        for (long i = 0; i < tileCount; ++i)
+        {
+            std::fill(tile.begin(), tile.end(), 0);
+            const auto origin = tileOrigin(i);
+            fillTile(origin.first, origin.second, tile.data());
+            if (TIFFWriteEncodedTile(out, i, tile.data(), tileCells * sizeof(Sample)) < 0)
+            {
+                return false;
+            }
+        }
     }
 
-    TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, 1);
+    return true;
+}
 
-    for (auto i = 0ul; i < matrix.size(); ++i)
+// Writes a single tiled image to a new TIFF. See writeTiledImage.
+template <typename Sample>
+void writeTiledTIFF(const string &filename, long width, long height, TiffCompression compression,
+                    const std::function<bool(long, long, Sample *)> &fillTile)
+{
+    TIFF * out = TIFFOpen(filename.data(), "w");
+    if (!out)
     {
-        memcpy(buf, matrix[i].data(), bytesPerLine);
-        if (TIFFWriteScanline(out, buf, i, 0) < 0)
-        {
-            cout << "Error Writing TIFF" << endl;
-            break;
-        }
+        cout << "Error Writing TIFF" << endl;
+        return;
+    }
+
+    if (!writeTiledImage(out, width, height, compression, fillTile))
+    {
+        cout << "Error Writing TIFF" << endl;
     }
 
     TIFFClose(out);
-    _TIFFfree(buf);
 }
 
-void writePathToTIFF(std::vector<std::vector<int>> matrix, std::string filename)
+// Copies the part of a matrix under the tile at (x, y) into the tile
+template <typename Sample>
+bool copyMatrixTile(const vector<vector<Sample>> &matrix, long x, long y, Sample *tile)
 {
-    TIFF * out = TIFFOpen(filename.data(), "w");
+    const long rows = std::min<long>(outputTileSize, matrix.size() - y);
+    const long columns = std::min<long>(outputTileSize, matrix[0].size() - x);
+    for (long row = 0; row < rows; ++row)
+    {
+        std::copy(matrix[y + row].begin() + x, matrix[y + row].begin() + x + columns, tile + row * outputTileSize);
+    }
 
-    int width = matrix[0].size();
-    int height = matrix.size();
-    int samplesPerPixel = 1;
+    return true;
+}
 
-    TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
-    TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
-    TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, samplesPerPixel);
-    TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, 32);
-    TIFFSetField(out, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-    TIFFSetField(out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-    TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-    TIFFSetField(out, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_INT);
+void writeMatrixToTIFF(const vector<vector<float>> &matrix, const string &filename, TiffCompression compression)
+{
+    writeTiledTIFF<float>(filename, matrix[0].size(), matrix.size(), compression,
+                          [&matrix](long x, long y, float *tile) { return copyMatrixTile(matrix, x, y, tile); });
+}
 
-    size_t bytesPerLine = width * sizeof(int);
-    int * buf = nullptr;
+void writePathToTIFF(const vector<vector<int>> &matrix, const string &filename, TiffCompression compression)
+{
+    writeTiledTIFF<int32_t>(filename, matrix[0].size(), matrix.size(), compression,
+                            [&matrix](long x, long y, int32_t *tile) { return copyMatrixTile(matrix, x, y, tile); });
+}
 
-    if (TIFFScanlineSize(out))
+/*
+ * Fills tiles of a width wide path raster from a route's cells, which are
+ * grouped by tile up front so each tile only visits its own cells.
+ * Tiles the route misses are left empty.
+ */
+std::function<bool(long, long, int32_t *)> routeTileFiller(const Route &route, long width)
+{
+    const int pathValue = 10;
+    const long tilesAcross = (width + outputTileSize - 1) / outputTileSize;
+
+    auto cellsByTile = std::make_shared<std::unordered_map<long, vector<Cell>>>();
+    for (const auto &cell : distinctCells(route))
     {
-        buf = (int *)_TIFFmalloc(bytesPerLine);
+        (*cellsByTile)[(cell.y / outputTileSize) * tilesAcross + cell.x / outputTileSize].push_back(cell);
     }
-    else
+
+    return [cellsByTile, tilesAcross, pathValue](long x, long y, int32_t *tile)
+    {
+        auto found = cellsByTile->find((y / outputTileSize) * tilesAcross + x / outputTileSize);
+        if (found == cellsByTile->end())
+        {
+            return false;
+        }
+
+        for (const auto &cell : found->second)
+        {
+            tile[(cell.y - y) * outputTileSize + cell.x - x] = pathValue;
+        }
+
+        return true;
+    };
+}
+
+void writeRouteToTIFF(const Route &route, long width, long height, const string &filename, TiffCompression compression)
+{
+    writeTiledTIFF<int32_t>(filename, width, height, compression, routeTileFiller(route, width));
+}
+
+RoutePagesTIFF::RoutePagesTIFF(const string &filename, long width, long height, TiffCompression compression)
+    : width(width), height(height), compression(compression)
+{
+    out = TIFFOpen(filename.data(), "w");
+}
+
+RoutePagesTIFF::~RoutePagesTIFF()
+{
+    if (out)
+    {
+        TIFFClose(out);
+    }
+}
+
+bool RoutePagesTIFF::addRoute(const Route &route, const string &pageName)
+{
+    if (!out)
+    {
+        return false;
+    }
+
+    TIFFSetField(out, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+    TIFFSetField(out, TIFFTAG_PAGENAME, pageName.data());
+    return writeTiledImage<int32_t>(out, width, height, compression, routeTileFiller(route, width)) &&
+           TIFFWriteDirectory(out);
+}
+
+void writeCostSurfaceToTIFF(const vector<double> &surface, long width, long height, const string &filename,
+                            TiffCompression compression)
+{
+    writeTiledTIFF<float>(filename, width, height, compression, [&](long x, long y, float *tile)
+    {
+        for (long row = 0; row < std::min(outputTileSize, height - y); ++row)
+        {
+            const double *cells = surface.data() + (y + row) * width + x;
+            std::copy(cells, cells + std::min(outputTileSize, width - x), tile + row * outputTileSize);
+        }
+        return true;
+    });
+}
+
+void writeDirectionsToTIFF(const vector<uint8_t> &directions, long width, long height, const string &filename,
+                           TiffCompression compression)
+{
+    writeTiledTIFF<uint8_t>(filename, width, height, compression, [&](long x, long y, uint8_t *tile)
+    {
+        for (long row = 0; row < std::min(outputTileSize, height - y); ++row)
+        {
+            const uint8_t *cells = directions.data() + (y + row) * width + x;
+            std::copy(cells, cells + std::min(outputTileSize, width - x), tile + row * outputTileSize);
+        }
+        return true;
+    });
+}
+
+vector<uint8_t> readDirectionsTIFF(const string &filename, long &width, long &height)
+{
+    TIFFSetWarningHandler(nullptr);
+    TIFF * tiff = TIFFOpen(filename.data(), "r");
+    vector<uint8_t> directions;
+    uint16 bitsPerSample = 0;
+    if (tiff && TIFFGetField(tiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample) && bitsPerSample == 8)
+    {
+        uint32 imageWidth, imageLength;
+        TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &imageWidth);
+        TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &imageLength);
+        width = imageWidth;
+        height = imageLength;
+        directions.resize(width * height);
+
+        visitTIFF<uint8_t>(tiff, [&](uint32 x, uint32 y, uint32 tileWidth, uint32 tileLength,
+                                     const uint8_t *cells, uint32 stride)
+        {
+            for (uint32 row = 0; row < tileLength; ++row)
+            {
+                std::copy(cells + row * stride, cells + row * stride + tileWidth,
+                          directions.begin() + (y + row) * width + x);
+            }
+        });
+    }
+
+    if (tiff)
     {
-        buf = (int *)_TIFFmalloc(TIFFScanlineSize(out));
+        TIFFClose(tiff);
     }
 
-    TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, 1);
+    return directions;
+}
+
+// GeoTIFF's tags, and the keys read from its key directory
+const uint32 geoPixelScaleTag = 33550;
+const uint32 geoTiepointTag = 33922;
+const uint32 geoKeyDirectoryTag = 34735;
+const uint16 modelTypeKey = 1024;
+const uint16 rasterTypeKey = 1025;
+const uint16 angularUnitsKey = 2054;
+const uint16 modelTypeGeographic = 2;
+const uint16 rasterPixelIsPoint = 2;
+const uint16 angularUnitDegree = 9102;
 
-    for (auto i = 0ul; i < matrix.size(); ++i)
+bool readGeoReference(const string &filename, GeoReference &reference)
+{
+    TIFFSetWarningHandler(nullptr);
+    TIFF * tiff = TIFFOpen(filename.data(), "r");
+    if (!tiff)
     {
-        memcpy(buf, matrix[i].data(), bytesPerLine);
-        if (TIFFWriteScanline(out, buf, i, 0) < 0)
+        return false;
+    }
+
+    // libtiff keeps GeoTIFF's tags as anonymous fields, read with their counts
+    uint32 scaleCount = 0, tiepointCount = 0, keyCount = 0;
+    double *scale = nullptr, *tiepoint = nullptr;
+    uint16 *keys = nullptr;
+    const bool found = TIFFGetField(tiff, geoPixelScaleTag, &scaleCount, &scale) && scaleCount >= 2
+                       && TIFFGetField(tiff, geoTiepointTag, &tiepointCount, &tiepoint) && tiepointCount >= 6
+                       && TIFFGetField(tiff, geoKeyDirectoryTag, &keyCount, &keys) && keyCount >= 4;
+    if (found)
+    {
+        // Keys follow a header of four, each as ID, location, count and value, with inline values at location 0
+        uint16 modelType = 0, rasterType = 1, angularUnits = angularUnitDegree;
+        for (uint32 key = 1; key <= keys[3] && 4 * key + 3 < keyCount; ++key)
         {
-            cout << "Error Writing TIFF" << endl;
-            break;
+            const uint16 *entry = keys + 4 * key;
+            if (entry[1] != 0)
+            {
+                continue;
+            }
+            switch (entry[0])
+            {
+                case modelTypeKey: modelType = entry[3]; break;
+                case rasterTypeKey: rasterType = entry[3]; break;
+                case angularUnitsKey: angularUnits = entry[3]; break;
+                default: break;
+            }
         }
+
+        // Tiepoints name a raster position and the model coordinates there; rows run down, model y up
+        const double centre = rasterType == rasterPixelIsPoint ? 0 : 0.5;
+        reference.columnStep = scale[0];
+        reference.rowStep = -scale[1];
+        reference.originX = tiepoint[3] + (centre - tiepoint[0]) * reference.columnStep;
+        reference.originY = tiepoint[4] + (centre - tiepoint[1]) * reference.rowStep;
+        reference.geographic = modelType == modelTypeGeographic && angularUnits == angularUnitDegree;
     }
 
-    TIFFClose(out);
-    _TIFFfree(buf);
-}
\ No newline at end of file
+    TIFFClose(tiff);
+    return found;
+}
+
+TiffCompression parseTiffCompression(const string &name)
+{
+    if (name == "none")
+    {
+        return TiffCompression::None;
+    }
+    if (name == "lzw")
+    {
+        return TiffCompression::LZW;
+    }
+    if (name == "zstd")
+    {
+        return TiffCompression::ZSTD;
+    }
+    if (name == "deflate")
+    {
+        return TiffCompression::Deflate;
+    }
+
+    throw std::runtime_error("Unknown TIFF compression " + name);
+}
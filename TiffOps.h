@@ -7,6 +7,9 @@
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <cstdint>
+#include "breadcrumbs.h"
 
 /*
  * Reads a TIFF into a 2D vector of floats.
@@ -14,18 +17,118 @@
  */
 std::vector<std::vector<float>> readTIFF(const std::string & filename);
 
+// Receives (x, y, width, length, cells, stride) for one tile of a streamed TIFF
+using TileVisitor = std::function<void(long, long, long, long, const float *, long)>;
+
+/*
+ * Streams a TIFF of 32-bit floats through visit, one tile or band of scanlines at a time,
+ * so the image is never held in memory whole.
+ * Returns false if the TIFF cannot be read or is not width by height.
+ */
+bool streamTIFF(const std::string & filename, long width, long height, const TileVisitor & visit);
+
+// Compression for written TIFFs. Each uses a predictor suited to its sample type.
+enum class TiffCompression { None, LZW, Deflate, ZSTD };
+
 /*
- * Writes a 2D matrix of floats to a TIFF.
+ * Parses "none", "lzw", "deflate" or "zstd".
+ * Throws std::runtime_error for anything else.
+ */
+TiffCompression parseTiffCompression(const std::string & name);
+
+/*
+ * Writes a 2D matrix of floats to a tiled, compressed TIFF.
+ * Deflate tiles are encoded in parallel. ZSTD falls back to deflate
+ * if libtiff was built without it.
  * No spatial reference is written.
  * The units per pixel is also not recorded.
  */
-void writeMatrixToTIFF(std::vector<std::vector<float>> matrix, const std::string & filename);
+void writeMatrixToTIFF(const std::vector<std::vector<float>> & matrix, const std::string & filename,
+                       TiffCompression compression = TiffCompression::Deflate);
 
 /*
- * Writes a 2D matrix of ints to a TIFF.
+ * Writes a 2D matrix of ints to a tiled, compressed TIFF.
  * No spatial reference is written.
  * The units per pixel is also not recorded.
  */
-void writePathToTIFF(std::vector<std::vector<int>> matrix, std::string filename);
+void writePathToTIFF(const std::vector<std::vector<int>> & matrix, const std::string & filename,
+                     TiffCompression compression = TiffCompression::Deflate);
+
+/*
+ * Rasterizes a route into a width by height tiled, compressed TIFF of ints,
+ * marking each cell on it. Tiles are filled from the route's cells, so no
+ * full-size matrix is built, and tiles the route misses are never encoded.
+ * No spatial reference is written.
+ */
+void writeRouteToTIFF(const Route & route, long width, long height, const std::string & filename,
+                      TiffCompression compression = TiffCompression::Deflate);
+
+/*
+ * Writes a row by row width by height cost surface, such as one from getCostSurface,
+ * to a tiled, compressed TIFF of floats. Unreachable cells are written as infinity.
+ */
+void writeCostSurfaceToTIFF(const std::vector<double> & surface, long width, long height,
+                            const std::string & filename, TiffCompression compression = TiffCompression::Deflate);
+
+/*
+ * Writes a route tree's direction codes, one byte per cell, to a tiled, compressed TIFF
+ * of 8-bit unsigned ints. See getCostSurface.
+ */
+void writeDirectionsToTIFF(const std::vector<uint8_t> & directions, long width, long height,
+                           const std::string & filename, TiffCompression compression = TiffCompression::Deflate);
+
+/*
+ * Reads a TIFF written by writeDirectionsToTIFF, setting width and height.
+ * Returns an empty vector if it cannot be read or does not hold bytes.
+ */
+std::vector<uint8_t> readDirectionsTIFF(const std::string & filename, long & width, long & height);
+
+/*
+ * Where a raster's cells lie on the ground, from its GeoTIFF tags.
+ * The centre of cell (x, y) is at (originX + x * columnStep, originY + y * rowStep)
+ * in the raster's model coordinates.
+ */
+struct GeoReference
+{
+    double originX = 0;
+    double originY = 0;
+    double columnStep = 1;
+    double rowStep = 1;
+    // True when model coordinates are longitude and latitude in degrees, rather than projected
+    bool geographic = false;
+};
+
+/*
+ * Reads a TIFF's GeoTIFF pixel scale, tiepoint and model type into reference.
+ * Returns false if it has none of them, or is only placed by a transformation matrix.
+ */
+bool readGeoReference(const std::string & filename, GeoReference & reference);
+
+/*
+ * A TIFF holding one tiled, compressed path raster page per route, such as
+ * every run of a sweep, so the runs share one file instead of one each.
+ * Each page is named with TIFFTAG_PAGENAME and written as soon as it is added.
+ */
+class RoutePagesTIFF
+{
+public:
+    RoutePagesTIFF(const std::string & filename, long width, long height,
+                   TiffCompression compression = TiffCompression::Deflate);
+    ~RoutePagesTIFF();
+
+    RoutePagesTIFF(const RoutePagesTIFF &) = delete;
+    RoutePagesTIFF &operator=(const RoutePagesTIFF &) = delete;
+
+    bool isOpen() const { return out != nullptr; }
+
+    // Appends a page marking each cell of the route. Returns false if it could not be written.
+    bool addRoute(const Route & route, const std::string & pageName);
+
+private:
+    struct tiff *out = nullptr;
+    long width;
+    long height;
+    TiffCompression compression;
+};
 
 #endif //BREADCRUMBS_TIFFOPS_H
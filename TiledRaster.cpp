@@ -0,0 +1,283 @@
+//
+// Out-of-core raster backed by a TIFF on disk.
+//
+
+#include <algorithm>
+#include "tiffio.h"
+#include "TiledRaster.h"
+
+using std::vector;
+using std::string;
+using std::shared_ptr;
+using std::make_shared;
+using std::lock_guard;
+using std::unique_lock;
+using std::mutex;
+
+// Bands of strips are grown until they hold at least this many cells
+const long minimumBandCells = 256 * 256;
+
+TiledRaster::TiledRaster(const string &filename, size_t cacheBytes) : filename(filename)
+{
+    TIFFSetWarningHandler(nullptr);
+    handle = TIFFOpen(filename.data(), "r");
+    if (!handle)
+    {
+        return;
+    }
+
+    uint32 width = 0, length = 0;
+    uint16 bitsPerSample = 0, sampleFormat = SAMPLEFORMAT_IEEEFP;
+    TIFFGetField(handle, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(handle, TIFFTAG_IMAGELENGTH, &length);
+    TIFFGetField(handle, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    TIFFGetField(handle, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+    if (bitsPerSample != 32 || sampleFormat != SAMPLEFORMAT_IEEEFP || width == 0 || length == 0)
+    {
+        TIFFClose(handle);
+        handle = nullptr;
+        return;
+    }
+
+    imageWidth = width;
+    imageLength = length;
+    tiled = TIFFIsTiled(handle);
+    if (tiled)
+    {
+        uint32 tw = 0, tl = 0;
+        TIFFGetField(handle, TIFFTAG_TILEWIDTH, &tw);
+        TIFFGetField(handle, TIFFTAG_TILELENGTH, &tl);
+        tileWidth = tw;
+        tileLength = tl;
+    }
+    else
+    {
+        uint32 rps = length;
+        TIFFGetField(handle, TIFFTAG_ROWSPERSTRIP, &rps);
+        rowsPerStrip = std::min<long>(rps, imageLength);
+        stripsPerTile = std::max(1l, minimumBandCells / (imageWidth * rowsPerStrip));
+        tileWidth = imageWidth;
+        tileLength = rowsPerStrip * stripsPerTile;
+    }
+
+    tilesAcross = (imageWidth + tileWidth - 1) / tileWidth;
+    tilesDown = (imageLength + tileLength - 1) / tileLength;
+
+    const size_t tileBytes = tileWidth * tileLength * sizeof(float);
+    maxTiles = std::max<size_t>(4, cacheBytes / tileBytes);
+
+    prefetchThread = std::thread(&TiledRaster::prefetchLoop, this);
+}
+
+TiledRaster::~TiledRaster()
+{
+    if (prefetchThread.joinable())
+    {
+        {
+            lock_guard<mutex> lock(cacheMutex);
+            stopPrefetching = true;
+        }
+        prefetchReady.notify_all();
+        prefetchThread.join();
+    }
+
+    if (handle)
+    {
+        TIFFClose(handle);
+    }
+}
+
+/*
+ * Decodes one tile, or one band of strips, into a full-size tile buffer.
+ * Cells past the edge of the image are left at zero.
+ */
+shared_ptr<const TiledRaster::Tile> TiledRaster::readTile(tiff *source, long tileIndex) const
+{
+    auto tile = make_shared<Tile>();
+    tile->data.assign(tileWidth * tileLength, 0.0f);
+    ++tileReads;
+
+    const long tileX = (tileIndex % tilesAcross) * tileWidth;
+    const long tileY = (tileIndex / tilesAcross) * tileLength;
+
+    if (tiled)
+    {
+        TIFFReadTile(source, tile->data.data(), tileX, tileY, 0, 0);
+    }
+    else
+    {
+        const long stripBytes = imageWidth * rowsPerStrip * sizeof(float);
+        for (long strip = 0; strip < stripsPerTile; ++strip)
+        {
+            const long row = tileY + strip * rowsPerStrip;
+            if (row >= imageLength)
+            {
+                break;
+            }
+
+            TIFFReadEncodedStrip(source,
+                                 TIFFComputeStrip(source, row, 0),
+                                 tile->data.data() + strip * rowsPerStrip * imageWidth,
+                                 stripBytes);
+        }
+    }
+
+    return tile;
+}
+
+void TiledRaster::insertTile(long tileIndex, const shared_ptr<const Tile> &tile) const
+{
+    if (cache.count(tileIndex))
+    {
+        return;
+    }
+
+    leastRecentlyUsed.push_front(tileIndex);
+    cache[tileIndex] = {tile, leastRecentlyUsed.begin()};
+
+    while (cache.size() > maxTiles)
+    {
+        cache.erase(leastRecentlyUsed.back());
+        leastRecentlyUsed.pop_back();
+    }
+}
+
+void TiledRaster::switchTile(long x, long y) const
+{
+    const long tileColumn = x / tileWidth;
+    const long tileRow = y / tileLength;
+    lastTile = getTile(tileRow * tilesAcross + tileColumn);
+    lastTileData = lastTile->data.data();
+    lastTileX = tileColumn * tileWidth;
+    lastTileY = tileRow * tileLength;
+}
+
+shared_ptr<const TiledRaster::Tile> TiledRaster::getTile(long tileIndex) const
+{
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        auto found = cache.find(tileIndex);
+        if (found != cache.end())
+        {
+            leastRecentlyUsed.splice(leastRecentlyUsed.begin(), leastRecentlyUsed, found->second.lruPosition);
+            return found->second.tile;
+        }
+    }
+
+    // The search thread owns the main handle, so the read itself happens outside the lock
+    auto tile = readTile(handle, tileIndex);
+
+    lock_guard<mutex> lock(cacheMutex);
+    insertTile(tileIndex, tile);
+    return tile;
+}
+
+void TiledRaster::prefetch(long x, long y) const
+{
+    const long tileColumn = x / tileWidth;
+    const long tileRow = y / tileLength;
+    const long centerIndex = tileRow * tilesAcross + tileColumn;
+    if (centerIndex == lastPrefetchIndex)
+    {
+        return;
+    }
+    lastPrefetchIndex = centerIndex;
+
+    bool queued = false;
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        for (long row = tileRow - 1; row <= tileRow + 1; ++row)
+        {
+            for (long column = tileColumn - 1; column <= tileColumn + 1; ++column)
+            {
+                if (row < 0 || column < 0 || row >= tilesDown || column >= tilesAcross)
+                {
+                    continue;
+                }
+
+                const long tileIndex = row * tilesAcross + column;
+                if (!cache.count(tileIndex) && prefetchPending.insert(tileIndex).second)
+                {
+                    prefetchQueue.push_back(tileIndex);
+                    queued = true;
+                }
+            }
+        }
+    }
+
+    if (queued)
+    {
+        prefetchReady.notify_one();
+    }
+}
+
+/*
+ * Runs on the prefetch thread with its own TIFF handle,
+ * since libtiff handles cannot be shared between threads.
+ */
+void TiledRaster::prefetchLoop()
+{
+    TIFF *source = TIFFOpen(filename.data(), "r");
+    if (!source)
+    {
+        return;
+    }
+
+    while (true)
+    {
+        long tileIndex;
+        {
+            unique_lock<mutex> lock(cacheMutex);
+            prefetchReady.wait(lock, [this] { return stopPrefetching || !prefetchQueue.empty(); });
+            if (stopPrefetching)
+            {
+                break;
+            }
+
+            tileIndex = prefetchQueue.front();
+            prefetchQueue.pop_front();
+            if (cache.count(tileIndex))
+            {
+                prefetchPending.erase(tileIndex);
+                continue;
+            }
+        }
+
+        auto tile = readTile(source, tileIndex);
+
+        lock_guard<mutex> lock(cacheMutex);
+        prefetchPending.erase(tileIndex);
+        insertTile(tileIndex, tile);
+    }
+
+    TIFFClose(source);
+}
+
+TiledCostRaster::TiledCostRaster(long width, long height, std::function<float(long, long)> elevationAt)
+    : columns(width),
+      rows(height),
+      elevationAt(std::move(elevationAt)),
+      memoBlocksAcross((width + memoMask) >> memoShift),
+      memo(memoBlocksAcross * ((height + memoMask) >> memoShift))
+{}
+
+float TiledCostRaster::evaluate(long x, long y) const
+{
+    ++evaluations;
+    float cost = 0;
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        const float value = layers[i]->at(x, y);
+        if (expressions[i].isIdentity())
+        {
+            cost += value * weights[i];
+        }
+        else
+        {
+            const float elevation = expressions[i].usesElevation() ? elevationAt(x, y) : 0;
+            cost += expressions[i].evaluate(value, elevation) * weights[i];
+        }
+    }
+
+    return cost;
+}
@@ -0,0 +1,206 @@
+//
+// Out-of-core raster backed by a TIFF on disk.
+//
+
+#ifndef BREADCRUMBS_TILEDRASTER_H
+#define BREADCRUMBS_TILEDRASTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include "LayerExpression.h"
+
+struct tiff;
+
+/*
+ * A 32-bit float raster which is never fully loaded into memory.
+ * Tiles (or bands of strips, for stripped TIFFs) are decoded on demand
+ * and kept in a least-recently-used cache no larger than the given budget.
+ * A background thread reads tiles ahead of the search frontier when asked
+ * through prefetch().
+ *
+ * Lookups are meant to come from a single search thread at a time.
+ */
+class TiledRaster
+{
+public:
+    TiledRaster(const std::string &filename, size_t cacheBytes);
+    ~TiledRaster();
+
+    TiledRaster(const TiledRaster &) = delete;
+    TiledRaster &operator=(const TiledRaster &) = delete;
+
+    // False if the file could not be opened or is not a 32-bit float TIFF
+    bool isOpen() const { return handle != nullptr; }
+
+    long width() const { return imageWidth; }
+    long height() const { return imageLength; }
+
+    float at(long x, long y) const
+    {
+        // Neighbouring lookups almost always land in the tile used last
+        const unsigned long column = x - lastTileX;
+        const unsigned long row = y - lastTileY;
+        if (column >= (unsigned long)tileWidth || row >= (unsigned long)tileLength)
+        {
+            switchTile(x, y);
+            return at(x, y);
+        }
+
+        return lastTileData[row * tileWidth + column];
+    }
+
+    // Queues the tile holding (x, y) and its eight neighbours for background reading
+    void prefetch(long x, long y) const;
+
+    size_t tilesRead() const { return tileReads; }
+
+private:
+    struct Tile
+    {
+        std::vector<float> data;
+    };
+
+    using TileList = std::list<long>;
+
+    struct CacheEntry
+    {
+        std::shared_ptr<const Tile> tile;
+        TileList::iterator lruPosition;
+    };
+
+    void switchTile(long x, long y) const;
+    std::shared_ptr<const Tile> getTile(long tileIndex) const;
+    std::shared_ptr<const Tile> readTile(tiff *source, long tileIndex) const;
+    void insertTile(long tileIndex, const std::shared_ptr<const Tile> &tile) const;
+    void prefetchLoop();
+
+    std::string filename;
+    tiff *handle = nullptr;
+    bool tiled = false;
+    long imageWidth = 0;
+    long imageLength = 0;
+    long tileWidth = 0;
+    long tileLength = 0;
+    long tilesAcross = 0;
+    long tilesDown = 0;
+    long stripsPerTile = 1;
+    long rowsPerStrip = 0;
+    size_t maxTiles = 0;
+
+    mutable long lastTileX = -(1l << 62);
+    mutable long lastTileY = -(1l << 62);
+    mutable const float *lastTileData = nullptr;
+    mutable std::shared_ptr<const Tile> lastTile;
+    mutable long lastPrefetchIndex = -1;
+    mutable std::atomic<size_t> tileReads{0};
+
+    mutable std::mutex cacheMutex;
+    mutable std::unordered_map<long, CacheEntry> cache;
+    mutable TileList leastRecentlyUsed;
+
+    mutable std::condition_variable prefetchReady;
+    mutable std::deque<long> prefetchQueue;
+    mutable std::unordered_set<long> prefetchPending;
+    bool stopPrefetching = false;
+    std::thread prefetchThread;
+};
+
+/*
+ * The weighted sum of several out-of-core cost layers, each passed through its expression.
+ * Nothing is computed up front: a cell's cost is evaluated the first time the search
+ * reads it and memoized in blocks allocated as the search reaches them, so a short leg
+ * over a large raster only evaluates the cells it relaxes.
+ * With no layers every cell costs nothing.
+ */
+class TiledCostRaster
+{
+public:
+    // elevationAt supplies the elevation for expressions which use it
+    TiledCostRaster(long width, long height, std::function<float(long, long)> elevationAt);
+
+    void addLayer(std::unique_ptr<TiledRaster> layer, float weight, LayerExpression expression = LayerExpression())
+    {
+        layers.push_back(std::move(layer));
+        weights.push_back(weight);
+        expressions.push_back(std::move(expression));
+    }
+
+    long width() const { return columns; }
+    long height() const { return rows; }
+
+    float at(long x, long y) const
+    {
+        if (layers.empty())
+        {
+            return 0;
+        }
+
+        auto &block = memo[(y >> memoShift) * memoBlocksAcross + (x >> memoShift)];
+        if (!block)
+        {
+            block = std::make_unique<MemoBlock>();
+        }
+
+        float &cost = block->costs[((y & memoMask) << memoShift) + (x & memoMask)];
+        uint64_t &evaluatedRow = block->evaluated[y & memoMask];
+        const uint64_t evaluatedBit = 1ull << (x & memoMask);
+        if (!(evaluatedRow & evaluatedBit))
+        {
+            cost = evaluate(x, y);
+            evaluatedRow |= evaluatedBit;
+        }
+
+        return cost;
+    }
+
+    void prefetch(long x, long y) const
+    {
+        for (const auto &layer : layers)
+        {
+            layer->prefetch(x, y);
+        }
+    }
+
+    size_t cellsEvaluated() const { return evaluations; }
+
+private:
+    static constexpr long memoShift = 6;
+    static constexpr long memoMask = (1 << memoShift) - 1;
+
+    /*
+     * The costs of a square of cells, and which of them have been evaluated. Any cost,
+     * NaN included, is a valid cost, so a separate bit marks each cell, one word per row.
+     */
+    struct MemoBlock
+    {
+        float costs[1 << (2 * memoShift)];
+        uint64_t evaluated[1 << memoShift];
+    };
+    static_assert(memoShift == 6, "Each row of a memo block is marked by one 64-bit word");
+
+    float evaluate(long x, long y) const;
+
+    long columns;
+    long rows;
+    std::function<float(long, long)> elevationAt;
+    std::vector<std::unique_ptr<TiledRaster>> layers;
+    std::vector<float> weights;
+    std::vector<LayerExpression> expressions;
+
+    long memoBlocksAcross;
+    mutable std::vector<std::unique_ptr<MemoBlock>> memo;
+    mutable size_t evaluations = 0;
+};
+
+#endif //BREADCRUMBS_TILEDRASTER_H
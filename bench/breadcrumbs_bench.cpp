@@ -0,0 +1,524 @@
+//
+// Benchmarks of the search's hot paths, its raster I/O and whole routes.
+//
+
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "breadcrumbs.h"
+#include "SearchSteps.h"
+#include "SearchControl.h"
+#include "QuantizedRaster.h"
+#include "RasterView.h"
+#include "TiffOps.h"
+#include "PathOps.h"
+#include "TerrainGenerator.h"
+#include "ThreadPool.h"
+
+using std::string;
+using std::vector;
+
+// The weights of the sample params: grade base 10 over a radius of 5, everything else 1
+const Weights sampleWeights = {1, 10, 5, 1, 1, 1, 1};
+
+// How many random steps the step benchmarks cycle through. A power of 2.
+constexpr size_t sampleSteps = 1 << 12;
+
+Matrix readGallery(const string &name)
+{
+    const auto matrix = readTIFF(string(BREADCRUMBS_GALLERY) + "/" + name);
+    if (matrix.empty())
+    {
+        throw std::runtime_error("Failed to read gallery TIFF " + name);
+    }
+    return matrix;
+}
+
+/*
+ * glen_alps.tif as each raster type the search reads, read once and shared
+ * by every benchmark.
+ */
+template <typename Raster>
+const Raster &glenAlps();
+
+template <>
+const Matrix &glenAlps<Matrix>()
+{
+    static const Matrix matrix = readGallery("glen_alps.tif");
+    return matrix;
+}
+
+template <>
+const RasterView &glenAlps<RasterView>()
+{
+    static const vector<float> cells = []
+    {
+        vector<float> flat;
+        for (const auto &row : glenAlps<Matrix>())
+        {
+            flat.insert(flat.end(), row.begin(), row.end());
+        }
+        return flat;
+    }();
+    static const RasterView view(cells.data(), rasterWidth(glenAlps<Matrix>()), rasterHeight(glenAlps<Matrix>()));
+    return view;
+}
+
+template <>
+const QuantizedRaster<uint16_t> &glenAlps<QuantizedRaster<uint16_t>>()
+{
+    static const QuantizedRaster<uint16_t> quantized(glenAlps<Matrix>());
+    return quantized;
+}
+
+// Random cells of a raster, each paired with one of its neighbours, the same on every run
+vector<std::pair<MatrixPoint, MatrixPoint>> randomSteps(long width, long height)
+{
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<long> randomX(1, width - 2);
+    std::uniform_int_distribution<long> randomY(1, height - 2);
+    std::uniform_int_distribution<int> randomDirection(1, 8);
+
+    vector<std::pair<MatrixPoint, MatrixPoint>> steps(sampleSteps);
+    for (auto &step : steps)
+    {
+        step.first.x = randomX(generator);
+        step.first.y = randomY(generator);
+        const int direction = randomDirection(generator);
+        step.second.x = step.first.x + directionX[direction];
+        step.second.y = step.first.y + directionY[direction];
+    }
+    return steps;
+}
+
+template <typename Raster>
+void BM_GradeCost(benchmark::State &state)
+{
+    const Raster &raster = glenAlps<Raster>();
+    const auto steps = randomSteps(rasterWidth(raster), rasterHeight(raster));
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        const auto &step = steps[i++ & (sampleSteps - 1)];
+        benchmark::DoNotOptimize(gradeCost(step.first, step.second, raster, sampleWeights));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_GradeCost, Matrix);
+BENCHMARK_TEMPLATE(BM_GradeCost, RasterView);
+BENCHMARK_TEMPLATE(BM_GradeCost, QuantizedRaster<uint16_t>);
+
+void BM_Distance(benchmark::State &state)
+{
+    const auto steps = randomSteps(1 << 10, 1 << 10);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        const auto &step = steps[i++ & (sampleSteps - 1)];
+        benchmark::DoNotOptimize(distance(step.first, step.second, 1.5, sampleWeights.movementCostXY,
+                                          sampleWeights.movementCostXY, sampleWeights.movementCostZ));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Distance);
+
+template <typename Raster>
+void BM_ScaledHeight(benchmark::State &state)
+{
+    const Raster &raster = glenAlps<Raster>();
+    const auto steps = randomSteps(rasterWidth(raster), rasterHeight(raster));
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        const auto &step = steps[i++ & (sampleSteps - 1)];
+        benchmark::DoNotOptimize(scaledHeight(raster, step.first, step.second, sampleWeights.unitsPerPixel));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_ScaledHeight, Matrix);
+BENCHMARK_TEMPLATE(BM_ScaledHeight, RasterView);
+BENCHMARK_TEMPLATE(BM_ScaledHeight, QuantizedRaster<uint16_t>);
+
+template <typename Raster>
+void BM_GetSurroundingPoints(benchmark::State &state)
+{
+    const Raster &raster = glenAlps<Raster>();
+    const auto steps = randomSteps(rasterWidth(raster), rasterHeight(raster));
+    // Reused as the search reuses it, resized back to 8 before every call
+    vector<MatrixPoint> surroundingPoints(8, MatrixPoint{});
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        surroundingPoints.resize(8);
+        getSurroundingPoints(raster, steps[i++ & (sampleSteps - 1)].first, surroundingPoints);
+        benchmark::DoNotOptimize(surroundingPoints.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_GetSurroundingPoints, Matrix);
+BENCHMARK_TEMPLATE(BM_GetSurroundingPoints, RasterView);
+
+// Random open list entries, the same on every run
+vector<MatrixPoint> randomQueuedPoints(long count)
+{
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> randomCost(0, 1e4);
+    vector<MatrixPoint> points(count);
+    for (long i = 0; i < count; ++i)
+    {
+        points[i].x = i;
+        points[i].totalCost = randomCost(generator);
+    }
+    return points;
+}
+
+// Fills the open list with as many points as the argument, then empties it
+void BM_PointQueueFillDrain(benchmark::State &state)
+{
+    const auto points = randomQueuedPoints(state.range(0));
+    for (auto _ : state)
+    {
+        PointQueue queue;
+        for (const auto &point : points)
+        {
+            queue.push(point);
+        }
+        while (!queue.empty())
+        {
+            benchmark::DoNotOptimize(queue.top().x);
+            queue.pop();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PointQueueFillDrain)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+
+/*
+ * Holds as many points as the argument, popping the cheapest and pushing a costlier one
+ * in its place, as an A* frontier of that size does.
+ */
+void BM_PointQueueSteady(benchmark::State &state)
+{
+    const auto points = randomQueuedPoints(state.range(0));
+    PointQueue queue;
+    for (const auto &point : points)
+    {
+        queue.push(point);
+    }
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        MatrixPoint next = queue.top();
+        queue.pop();
+        next.totalCost += points[i++ % points.size()].totalCost * 1e-3;
+        queue.push(next);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PointQueueSteady)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+
+void BM_ReadTIFF(benchmark::State &state, const string &name)
+{
+    const string filename = string(BREADCRUMBS_GALLERY) + "/" + name;
+    long cells = 0;
+    for (auto _ : state)
+    {
+        const auto matrix = readTIFF(filename);
+        cells = rasterWidth(matrix) * rasterHeight(matrix);
+        benchmark::DoNotOptimize(matrix.data());
+    }
+    state.SetBytesProcessed(state.iterations() * cells * (long)sizeof(float));
+}
+BENCHMARK_CAPTURE(BM_ReadTIFF, glen_alps, string("glen_alps.tif"))->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ReadTIFF, donnelly_dome, string("donnelly-dome.tif"))->Unit(benchmark::kMillisecond);
+
+// Where the writer benchmarks write, removed as each finishes
+string scratchFile(const string &extension)
+{
+    return (std::filesystem::temp_directory_path() / ("breadcrumbs_bench" + extension)).string();
+}
+
+// The route the sample params find over glen_alps.tif, found once
+const Route &glenAlpsRoute()
+{
+    static const Route route = []
+    {
+        const Matrix &elevation = glenAlps<Matrix>();
+        const Matrix cost(elevation.size(), vector<float>(elevation[0].size(), 0.0f));
+        std::deque<MatrixPoint> points(3);
+        points[0].x = 10; points[0].y = 10;
+        points[1].x = 300; points[1].y = 250;
+        points[2].x = 700; points[2].y = 1000;
+        return getShortestPath(elevation, cost, points, sampleWeights);
+    }();
+    return route;
+}
+
+void BM_WriteMatrixToTIFF(benchmark::State &state, TiffCompression compression)
+{
+    const Matrix &matrix = glenAlps<Matrix>();
+    const string filename = scratchFile(".tif");
+    for (auto _ : state)
+    {
+        writeMatrixToTIFF(matrix, filename, compression);
+    }
+    state.SetBytesProcessed(state.iterations() * rasterWidth(matrix) * rasterHeight(matrix) * (long)sizeof(float));
+    std::filesystem::remove(filename);
+}
+BENCHMARK_CAPTURE(BM_WriteMatrixToTIFF, none, TiffCompression::None)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_WriteMatrixToTIFF, lzw, TiffCompression::LZW)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_WriteMatrixToTIFF, deflate, TiffCompression::Deflate)->Unit(benchmark::kMillisecond);
+
+void BM_WritePathToTIFF(benchmark::State &state)
+{
+    const Matrix &elevation = glenAlps<Matrix>();
+    vector<vector<int>> path(elevation.size(), vector<int>(elevation[0].size(), 0));
+    for (const auto &cell : distinctCells(glenAlpsRoute()))
+    {
+        path[cell.y][cell.x] = 1;
+    }
+    const string filename = scratchFile(".tif");
+    for (auto _ : state)
+    {
+        writePathToTIFF(path, filename);
+    }
+    std::filesystem::remove(filename);
+}
+BENCHMARK(BM_WritePathToTIFF)->Unit(benchmark::kMillisecond);
+
+void BM_WriteRouteToTIFF(benchmark::State &state)
+{
+    const Matrix &elevation = glenAlps<Matrix>();
+    const string filename = scratchFile(".tif");
+    for (auto _ : state)
+    {
+        writeRouteToTIFF(glenAlpsRoute(), rasterWidth(elevation), rasterHeight(elevation), filename);
+    }
+    std::filesystem::remove(filename);
+}
+BENCHMARK(BM_WriteRouteToTIFF)->Unit(benchmark::kMillisecond);
+
+void BM_WriteCostSurfaceToTIFF(benchmark::State &state)
+{
+    const Matrix &elevation = glenAlps<Matrix>();
+    const long width = rasterWidth(elevation);
+    const long height = rasterHeight(elevation);
+    // A surface with the spread of a real one, without searching for it
+    vector<double> surface(width * height);
+    for (long y = 0; y < height; ++y)
+    {
+        for (long x = 0; x < width; ++x)
+        {
+            surface[y * width + x] = std::hypot(x, y) * 10 + elevation[y][x];
+        }
+    }
+    const string filename = scratchFile(".tif");
+    for (auto _ : state)
+    {
+        writeCostSurfaceToTIFF(surface, width, height, filename);
+    }
+    std::filesystem::remove(filename);
+}
+BENCHMARK(BM_WriteCostSurfaceToTIFF)->Unit(benchmark::kMillisecond);
+
+void BM_WriteDirectionsToTIFF(benchmark::State &state)
+{
+    const Matrix &elevation = glenAlps<Matrix>();
+    const long width = rasterWidth(elevation);
+    const long height = rasterHeight(elevation);
+    vector<uint8_t> directions(width * height);
+    std::mt19937 generator(42);
+    for (auto &direction : directions)
+    {
+        direction = (uint8_t)(generator() % 9);
+    }
+    const string filename = scratchFile(".tif");
+    for (auto _ : state)
+    {
+        writeDirectionsToTIFF(directions, width, height, filename);
+    }
+    std::filesystem::remove(filename);
+}
+BENCHMARK(BM_WriteDirectionsToTIFF)->Unit(benchmark::kMillisecond);
+
+// Glen Alps is projected, so the cells are placed at a stand-in geographic reference of about the same spacing
+GeoReference standInReference()
+{
+    GeoReference reference;
+    reference.originX = -149.7;
+    reference.originY = 61.1;
+    reference.columnStep = 9e-5;
+    reference.rowStep = -4.5e-5;
+    reference.geographic = true;
+    return reference;
+}
+
+void BM_WriteRouteToGeoJSON(benchmark::State &state)
+{
+    const string filename = scratchFile(".geojson");
+    const GeoReference reference = standInReference();
+    for (auto _ : state)
+    {
+        writeRouteToGeoJSON(glenAlpsRoute(), filename, reference);
+    }
+    std::filesystem::remove(filename);
+}
+BENCHMARK(BM_WriteRouteToGeoJSON)->Unit(benchmark::kMicrosecond);
+
+void BM_WriteRouteToGPX(benchmark::State &state)
+{
+    const string filename = scratchFile(".gpx");
+    const GeoReference reference = standInReference();
+    for (auto _ : state)
+    {
+        writeRouteToGPX(glenAlpsRoute(), filename, reference);
+    }
+    std::filesystem::remove(filename);
+}
+BENCHMARK(BM_WriteRouteToGPX)->Unit(benchmark::kMicrosecond);
+
+// Reports the cells a route expands, and how many it expanded a second over every iteration
+void countRoute(benchmark::State &state, const SearchStats &stats, long expanded)
+{
+    state.counters["expanded"] = (double)stats.expanded;
+    state.counters["expanded_rate"] = benchmark::Counter((double)expanded, benchmark::Counter::kIsRate);
+}
+
+// Routes through points over a gallery TIFF with no cost layers
+void BM_RouteGallery(benchmark::State &state, const string &name, const vector<Cell> &cells)
+{
+    const Matrix elevation = readGallery(name);
+    const Matrix cost(elevation.size(), vector<float>(elevation[0].size(), 0.0f));
+    std::deque<MatrixPoint> points;
+    for (const auto &cell : cells)
+    {
+        MatrixPoint point;
+        point.x = cell.x;
+        point.y = cell.y;
+        points.push_back(point);
+    }
+
+    SearchStats stats;
+    long expanded = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(getShortestPath(elevation, cost, points, sampleWeights, nullptr, nullptr, &stats));
+        expanded += stats.expanded;
+    }
+    countRoute(state, stats, expanded);
+}
+BENCHMARK_CAPTURE(BM_RouteGallery, glen_alps, string("glen_alps.tif"), vector<Cell>{{10, 10}, {300, 250}, {700, 1000}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_RouteGallery, donnelly_dome, string("donnelly-dome.tif"), vector<Cell>{{50, 47}, {457, 425}})
+    ->Unit(benchmark::kMillisecond);
+
+// Shared by the benchmarks which build terrains
+ThreadPool &benchmarkPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+// Whether a raster of this many bytes, with room to search it, fits in physical memory
+bool fitsInMemory(double bytes)
+{
+    const double physical = (double)sysconf(_SC_PHYS_PAGES) * (double)sysconf(_SC_PAGE_SIZE);
+    return bytes + (1L << 30) < physical;
+}
+
+// Generates a square terrain, reporting how many cells a second the pool generates
+void BM_GenerateTerrain(benchmark::State &state)
+{
+    TerrainSettings settings;
+    settings.width = settings.height = state.range(0);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(generateElevation(settings, benchmarkPool()).data());
+    }
+    state.SetItemsProcessed(state.iterations() * settings.width * settings.height);
+    state.counters["threads"] = benchmarkPool().size();
+}
+BENCHMARK(BM_GenerateTerrain)->Arg(1 << 10)->Arg(1 << 12)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/*
+ * A generated terrain and a cost layer of 5 classes for it, size cells square and
+ * centred on the field's origin, so its middle is the same at every size.
+ * Only the terrain of the running benchmark is kept.
+ */
+struct SyntheticTerrain
+{
+    long size = 0;
+    vector<float> elevation;
+    vector<float> cost;
+};
+
+const SyntheticTerrain &syntheticTerrain(long size)
+{
+    static SyntheticTerrain terrain;
+    if (terrain.size != size)
+    {
+        terrain = SyntheticTerrain();
+
+        TerrainSettings settings;
+        settings.width = settings.height = size;
+        settings.originX = settings.originY = -size / 2;
+        terrain.elevation = generateElevation(settings, benchmarkPool());
+        terrain.cost = generateCostLayer(settings, 5, benchmarkPool());
+        terrain.size = size;
+    }
+    return terrain;
+}
+
+/*
+ * Routes across a 1000 cell square in the middle of a synthetic terrain as big as the
+ * argument. Once the terrain is big enough not to hem the search in, it does the same
+ * work at every size, so the time it gains with the terrain's size is what the size
+ * alone costs it, in cache and TLB misses. Sizes whose rasters would not fit in
+ * physical memory, at 8 bytes a cell, are skipped.
+ */
+void BM_RouteSynthetic(benchmark::State &state)
+{
+    const long size = state.range(0);
+    if (!fitsInMemory((double)size * size * 2 * sizeof(float)))
+    {
+        state.SkipWithError("Not enough memory for this terrain");
+        return;
+    }
+    const SyntheticTerrain *terrain;
+    try
+    {
+        terrain = &syntheticTerrain(size);
+    }
+    catch (std::bad_alloc &)
+    {
+        state.SkipWithError("Not enough memory for this terrain");
+        return;
+    }
+
+    const RasterView elevation(terrain->elevation.data(), size, size);
+    const RasterView cost(terrain->cost.data(), size, size);
+    std::deque<MatrixPoint> points(2);
+    points[0].x = size / 2 - 500; points[0].y = size / 2 - 500;
+    points[1].x = size / 2 + 499; points[1].y = size / 2 + 499;
+
+    SearchStats stats;
+    long expanded = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(getShortestPath(elevation, cost, points, sampleWeights, nullptr, nullptr, &stats));
+        expanded += stats.expanded;
+    }
+    countRoute(state, stats, expanded);
+}
+BENCHMARK(BM_RouteSynthetic)->RangeMultiplier(2)->Range(1 << 10, 1 << 15)->Arg(50000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -8,7 +8,22 @@
 #include <queue>
 #include <deque>
 #include <utility>
+#include <algorithm>
+#include <limits>
+#include <atomic>
+#include <cstring>
+#include <tuple>
+#include <thread>
+#include <chrono>
 #include "breadcrumbs.h"
+#include "TiledRaster.h"
+#include "QuantizedRaster.h"
+#include "RasterView.h"
+#include "SearchProgress.h"
+#include "SearchControl.h"
+#include "ThreadPool.h"
+#include "MpscQueue.h"
+#include "SearchSteps.h"
 
 using std::vector;
 using std::deque;
@@ -17,108 +32,250 @@ using std::make_unique;
 using std::shared_ptr;
 using std::priority_queue;
 
-bool inBounds(const Matrix &matrix, const MatrixPoint &p)
+/*
+ * Per-leg search bookkeeping, allocated in square blocks as the search first touches them.
+ * A short leg over a huge raster only pays for the area it explores.
+ */
+class PagedGrid
 {
-    return (p.x > -1 && p.y > -1) && p.y < matrix.size() && p.x < matrix[0].size();
-}
-
-void getSurroundingPoints(const Matrix &matrix, const MatrixPoint &currentPoint, vector<MatrixPoint> &surroundingPoints)
-{
-    auto stepSize = 1;
+public:
+    PagedGrid(long width, long height)
+        : blocksAcross((width + blockMask) >> blockShift),
+          blocks(blocksAcross * ((height + blockMask) >> blockShift))
+    {}
 
-    auto writeIndex = 0;
-    for (long x = currentPoint.x - stepSize; x <= currentPoint.x + stepSize; x += stepSize)
+    MatrixPoint &operator()(long x, long y)
     {
-        for (long y = currentPoint.y - stepSize; y <= currentPoint.y + stepSize; y += stepSize)
+        auto &block = blocks[(y >> blockShift) * blocksAcross + (x >> blockShift)];
+        if (!block)
         {
-            if(!(x == currentPoint.x && y == currentPoint.y) && inBounds(matrix, {x, y}))
-            {
-                surroundingPoints[writeIndex].x = x;
-                surroundingPoints[writeIndex].y = y;
-                surroundingPoints[writeIndex].movementCost = 0;
-                surroundingPoints[writeIndex].totalCost = 0;
-                ++writeIndex;
-            }
+            block = make_unique<MatrixPoint[]>(1 << (2 * blockShift));
+            ++blocksAllocated;
         }
+
+        return block[((y & blockMask) << blockShift) + (x & blockMask)];
     }
 
-    surroundingPoints.resize(writeIndex);
-}
+    // The blocks touched so far and the table of them
+    long allocatedBytes() const
+    {
+        return blocksAllocated * (long)sizeof(MatrixPoint) * (1 << (2 * blockShift))
+               + (long)(blocks.size() * sizeof(blocks[0]));
+    }
 
-double distance(const MatrixPoint &a, const MatrixPoint &b, double height = 0, double xScale = 1, double yScale = 1, double zScale = 1)
-{
-    auto xScaled = (double)(b.x - a.x) * xScale;
-    auto yScaled = (double)(b.y - a.y) * yScale;
-    auto zScaled = height * zScale;
+private:
+    static constexpr long blockShift = 6;
+    static constexpr long blockMask = (1 << blockShift) - 1;
 
-    return std::sqrt(xScaled*xScaled + yScaled*yScaled + zScaled*zScaled);
-}
+    long blocksAcross;
+    vector<std::unique_ptr<MatrixPoint[]>> blocks;
+    long blocksAllocated = 0;
+};
 
-double scaledHeight(const Matrix &matrix, const MatrixPoint &a, const MatrixPoint &b, const double &unitsPerPixel)
+/*
+ * Times the phases of one expansion in every sampleInterval for an instrumented search,
+ * scaling what it times by the interval, so the totals estimate the whole search's while
+ * the clock is read for few expansions. Does nothing between sampled expansions.
+ * Phases take tens of nanoseconds, about as long as reading the clock, so what a read
+ * costs is measured once and taken off each time.
+ */
+class PhaseTimer
 {
-    double scaleFactor = 1 / unitsPerPixel;
-    return std::abs(matrix[b.y][b.x] - matrix[a.y][a.x]) * scaleFactor;
-}
+public:
+    static constexpr long sampleInterval = 16;
 
-double gradeCost(const MatrixPoint &currentPoint, const MatrixPoint &successor, const Matrix &matrix, const Weights &weights)
-{
-    long x = currentPoint.x;
-    long y = currentPoint.y;
-    const long xDiff = successor.x - currentPoint.x;
-    const long yDiff = successor.y - currentPoint.y;
+    // Starts timing an expansion if the search is instrumented and this expansion is sampled
+    void begin(bool instrument, long expansion)
+    {
+        sampling = instrument && expansion % sampleInterval == 0;
+        if (sampling)
+        {
+            mark = Clock::now();
+        }
+    }
 
-    double worstHeight = 0;
+    // Charges the time since the last mark to a phase
+    void lap(double &milliseconds)
+    {
+        if (sampling)
+        {
+            static const double readMilliseconds = clockReadMilliseconds();
+            const auto now = Clock::now();
+            const double elapsed = std::chrono::duration<double, std::milli>(now - mark).count();
+            milliseconds += std::max(0.0, elapsed - readMilliseconds) * sampleInterval;
+            mark = now;
+        }
+    }
 
-    const unsigned int radius = weights.gradeRadius;
-    for (auto i = 0u; i < radius; ++i)
+    // Moves the mark on without charging the time since to any phase
+    void skip()
     {
-        if (inBounds(matrix, {x + xDiff, y + yDiff}) && inBounds(matrix, {x, y}))
+        if (sampling)
         {
-            worstHeight = std::max(worstHeight,
-                                   scaledHeight(matrix, {x, y}, {x + xDiff, y + yDiff}, weights.unitsPerPixel));
+            mark = Clock::now();
         }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
 
-        x += xDiff;
-        y += yDiff;
+    static double clockReadMilliseconds()
+    {
+        const int reads = 1000;
+        const auto first = Clock::now();
+        auto last = first;
+        for (int i = 0; i < reads; ++i)
+        {
+            last = Clock::now();
+        }
+        return std::chrono::duration<double, std::milli>(last - first).count() / reads;
+    }
+
+    bool sampling = false;
+    Clock::time_point mark;
+};
+
+Weights canonicalWeights(Weights weights)
+{
+    if (weights.gradeRadius == 0 || weights.gradeBase == 1)
+    {
+        weights.gradeRadius = 0;
+        weights.gradeBase = 1;
+
+        if (weights.movementCostZ == 0 && weights.heuristicZ == 0 && std::isfinite(1 / weights.unitsPerPixel))
+        {
+            weights.unitsPerPixel = 1;
+        }
     }
 
-    return std::pow(weights.gradeBase, worstHeight / distance(currentPoint, successor));
+    return weights;
+}
+
+// The route from a leg's start to a searched cell, following each cell's parent
+Leg traceParents(PagedGrid &pathMatrix, MatrixPoint point)
+{
+    Leg leg;
+    leg.push_back({point.x, point.y});
+    while(point.parent != std::make_pair<long, long>(-1, -1))
+    {
+        point = pathMatrix(point.parent.first, point.parent.second);
+        leg.push_back({point.x, point.y});
+    }
+
+    std::reverse(leg.begin(), leg.end());
+    return leg;
 }
 
 //controlPoints needs to be a deque because the algorithm needs to pop things off the front quickly but also have
 //random access. std::queue does not have random access.
 //controlPoints must also be passed by value, to allow it to be used multiple times
-vector<vector<int>> getShortestPath(const Matrix &elevationMatrix,
-                                    const Matrix &costMatrix,
+template <typename ElevationRaster, typename CostRaster>
+Route getShortestPath(const ElevationRaster &elevationMatrix,
+                                    const CostRaster &costMatrix,
                                     deque<MatrixPoint> controlPoints,
-                                    const Weights &weights)
+                                    const Weights &weights,
+                                    SearchProgress *progress,
+                                    const CancellationToken *cancellation,
+                                    SearchStats *stats)
 {
-    auto finalMatrix = vector<vector<int>>(elevationMatrix.size(), vector<int>(elevationMatrix[0].size(), 0));
-    auto visitedPoint = 10;
+    const long width = rasterWidth(elevationMatrix);
+    const long height = rasterHeight(elevationMatrix);
+
+    // Cells waiting in the queue in each block of the frontier mask, kept only when a reader asks for it
+    const long frontierScale = progress ? progress->frontierScale() : 0;
+    const long frontierWidth = frontierScale > 0 ? (width + frontierScale - 1) / frontierScale : 0;
+    const long frontierHeight = frontierScale > 0 ? (height + frontierScale - 1) / frontierScale : 0;
+    vector<uint32_t> frontierCounts;
+    auto frontierBlock = [&](const MatrixPoint &point) -> uint32_t &
+    {
+        return frontierCounts[(point.y / frontierScale) * frontierWidth + point.x / frontierScale];
+    };
+
+    Route route;
     MatrixPoint finishingPoint;
+    long expanded = 0;
+    long totalExpanded = 0;
+    SearchStatus status = SearchStatus::Complete;
+
+    const bool instrument = stats && stats->instrument;
+    if (instrument)
+    {
+        stats->legStats.clear();
+    }
+    PhaseTimer timer;
+
     while (controlPoints.size() >= 2)
     {
         MatrixPoint startingPoint = controlPoints[0];
         MatrixPoint target = controlPoints[1];
+        // Read once, since the target usually lies in a different tile from the frontier
+        const float targetHeight = rasterAt(elevationMatrix, target.x, target.y);
 
-        auto differenceGreater = [](auto a, auto b) { return a.totalCost > b.totalCost; };
-        using PointQueue = priority_queue<MatrixPoint, vector<MatrixPoint>, decltype(differenceGreater)>;
-        PointQueue pointQueue(differenceGreater);
+        LegStats leg;
+        std::chrono::steady_clock::time_point legStart;
+        if (instrument)
+        {
+            legStart = std::chrono::steady_clock::now();
+            leg.pushes = 1;
+            leg.peakOpen = 1;
+        }
+
+        PointQueue pointQueue;
 
         pointQueue.push(startingPoint);
 
-        auto pathMatrix = vector<vector<MatrixPoint>>(elevationMatrix.size(), vector<MatrixPoint>(elevationMatrix[0].size(), MatrixPoint{}));
+        PagedGrid pathMatrix(width, height);
         startingPoint.visited = true;
-        pathMatrix[startingPoint.y][startingPoint.x]= startingPoint;
+        pathMatrix(startingPoint.x, startingPoint.y) = startingPoint;
+
+        expanded = 0;
+        if (frontierScale > 0)
+        {
+            frontierCounts.assign(frontierWidth * frontierHeight, 0);
+            ++frontierBlock(startingPoint);
+        }
 
         vector<MatrixPoint> surroundingPoints(8, MatrixPoint{});
 
         bool stop = false;
         while (!stop && !pointQueue.empty())
         {
+            if (cancellation && expanded % CancellationToken::checkInterval == 0
+                && (status = cancellation->check()) != SearchStatus::Complete)
+            {
+                break;
+            }
+
+            timer.begin(instrument, expanded);
             auto currentPoint = pointQueue.top();
             pointQueue.pop();
+            timer.lap(leg.queueMilliseconds);
             finishingPoint = currentPoint;
+            rasterPrefetch(elevationMatrix, currentPoint.x, currentPoint.y);
+            rasterPrefetch(costMatrix, currentPoint.x, currentPoint.y);
+
+            ++expanded;
+            if (progress)
+            {
+                if (frontierScale > 0)
+                {
+                    --frontierBlock(currentPoint);
+                }
+                if (expanded % progress->interval() == 0)
+                {
+                    SearchSnapshot snapshot;
+                    snapshot.leg = route.size();
+                    snapshot.expanded = expanded;
+                    snapshot.bestPath = traceParents(pathMatrix, currentPoint);
+                    snapshot.frontierWidth = frontierWidth;
+                    snapshot.frontierHeight = frontierHeight;
+                    for (const auto count : frontierCounts)
+                    {
+                        snapshot.frontier.push_back(count > 0);
+                    }
+                    progress->publish(std::move(snapshot));
+                }
+            }
 
             surroundingPoints.resize(8);
             getSurroundingPoints(elevationMatrix, currentPoint, surroundingPoints);
@@ -131,41 +288,18 @@ vector<vector<int>> getShortestPath(const Matrix &elevationMatrix,
                     break;
                 }
 
-                if (!pathMatrix[successor.y][successor.x].visited)
+                if (!pathMatrix(successor.x, successor.y).visited)
                 {
+                    timer.skip();
                     successor.visited =true;
-                    double heightToSuccessor = scaledHeight(
-                            elevationMatrix,
-                            currentPoint,
-                            successor,
-                            weights.unitsPerPixel
-                    );
-
                     successor.movementCost = (
-                            distance(
-                                currentPoint,
-                                successor,
-                                heightToSuccessor,
-                                weights.movementCostXY,
-                                weights.movementCostXY,
-                                weights.movementCostZ
-                            )
-                          + gradeCost(
-                                    currentPoint,
-                                    successor,
-                                    elevationMatrix,
-                                    weights
-                            )
+                            stepCost(elevationMatrix, currentPoint, successor, weights)
                           + currentPoint.movementCost
-                          + costMatrix[successor.y][successor.x]
+                          + rasterAt(costMatrix, successor.x, successor.y)
                     );
 
-                    const double heightToTarget = scaledHeight(
-                            elevationMatrix,
-                            successor,
-                            target,
-                            weights.unitsPerPixel
-                    );
+                    const double heightToTarget = std::abs(targetHeight - rasterAt(elevationMatrix, successor.x, successor.y))
+                                                  * (1 / weights.unitsPerPixel);
                     double distToTarget = distance(
                         successor,
                         target,
@@ -176,23 +310,1048 @@ vector<vector<int>> getShortestPath(const Matrix &elevationMatrix,
                     );
 
                     successor.totalCost = successor.movementCost + distToTarget;
+                    timer.lap(leg.stepCostMilliseconds);
 
                     successor.parent = {currentPoint.x, currentPoint.y};
                     pointQueue.push(successor);
-                    pathMatrix[successor.y][successor.x] = successor;
+                    timer.lap(leg.queueMilliseconds);
+                    if (instrument)
+                    {
+                        ++leg.pushes;
+                        leg.peakOpen = std::max(leg.peakOpen, (long)pointQueue.size());
+                    }
+                    pathMatrix(successor.x, successor.y) = successor;
+                    if (frontierScale > 0)
+                    {
+                        ++frontierBlock(successor);
+                    }
                 }
             }
         }
 
+        totalExpanded += expanded;
+        if (instrument)
+        {
+            leg.expanded = expanded;
+            leg.bytesAllocated = pathMatrix.allocatedBytes() + leg.peakOpen * (long)sizeof(MatrixPoint);
+            leg.milliseconds = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - legStart).count();
+            stats->legStats.push_back(leg);
+        }
+        if (status != SearchStatus::Complete)
+        {
+            break;
+        }
+
         controlPoints.pop_front();
-        while(finishingPoint.parent != std::make_pair<long, long>(-1, -1))
+        route.push_back(traceParents(pathMatrix, finishingPoint));
+    }
+
+    if (stats)
+    {
+        stats->status = status;
+        stats->expanded = totalExpanded;
+        stats->legs = route.size();
+    }
+
+    if (progress)
+    {
+        // The leg it finished last, or the one it stopped in, which has no path
+        SearchSnapshot snapshot;
+        snapshot.expanded = expanded;
+        if (status != SearchStatus::Complete)
+        {
+            snapshot.leg = route.size();
+        }
+        else if (!route.empty())
+        {
+            snapshot.leg = route.size() - 1;
+            snapshot.bestPath = route.back();
+        }
+        snapshot.finished = true;
+        progress->publish(std::move(snapshot));
+    }
+
+    return route;
+}
+
+template <typename ElevationRaster, typename CostRaster>
+double getRouteCost(const ElevationRaster &elevationMatrix,
+                    const CostRaster &costMatrix,
+                    const Route &route,
+                    const Weights &weights)
+{
+    double cost = 0;
+    for (const auto &leg : route)
+    {
+        for (size_t i = 1; i < leg.size(); ++i)
+        {
+            MatrixPoint from;
+            from.x = leg[i - 1].x;
+            from.y = leg[i - 1].y;
+            MatrixPoint to;
+            to.x = leg[i].x;
+            to.y = leg[i].y;
+            cost += stepCost(elevationMatrix, from, to, weights) + rasterAt(costMatrix, to.x, to.y);
+        }
+    }
+
+    return cost;
+}
+
+/*
+ * The cost of the step which relaxes neighbour from current in a cost surface,
+ * Towards the origin, each step is taken from the neighbour into the current cell.
+ * A least cost only exists without negative steps, which nodata in a cost layer can give,
+ * so they are free.
+ */
+template <typename ElevationRaster, typename CostRaster>
+double surfaceStep(const ElevationRaster &elevationMatrix, const CostRaster &costMatrix, const MatrixPoint &current,
+                   const MatrixPoint &neighbour, const Weights &weights, SurfaceDirection direction)
+{
+    const double step = direction == SurfaceDirection::FromOrigin
+            ? stepCost(elevationMatrix, current, neighbour, weights) + rasterAt(costMatrix, neighbour.x, neighbour.y)
+            : stepCost(elevationMatrix, neighbour, current, weights) + rasterAt(costMatrix, current.x, current.y);
+    return std::max(step, 0.0);
+}
+
+// The direction code of a step to a neighbour
+uint8_t directionCode(long xStep, long yStep)
+{
+    for (uint8_t code = 1; code <= 8; ++code)
+    {
+        if (directionX[code] == xStep && directionY[code] == yStep)
+        {
+            return code;
+        }
+    }
+    return 0;
+}
+
+Leg followDirections(const vector<uint8_t> &directions, long width, long height, Cell from)
+{
+    Leg leg = {from};
+    // A valid tree has no cycles, but a corrupt one must not loop forever
+    for (long steps = 0; steps < width * height; ++steps)
+    {
+        const auto &cell = leg.back();
+        const uint8_t code = directions[cell.y * width + cell.x];
+        if (code == 0 || code > 8)
         {
-            finalMatrix[finishingPoint.y][finishingPoint.x] = visitedPoint;
-            finishingPoint = pathMatrix[finishingPoint.parent.second][finishingPoint.parent.first];
+            break;
         }
 
-        fill(pathMatrix.begin(), pathMatrix.end(), vector<MatrixPoint>(pathMatrix.size(), MatrixPoint{}));
+        const Cell next = {cell.x + directionX[code], cell.y + directionY[code]};
+        if (next.x < 0 || next.y < 0 || next.x >= width || next.y >= height)
+        {
+            break;
+        }
+        leg.push_back(next);
+    }
+
+    return leg;
+}
+
+template <typename ElevationRaster, typename CostRaster>
+vector<double> getCostSurface(const ElevationRaster &elevationMatrix,
+                              const CostRaster &costMatrix,
+                              const MatrixPoint &origin,
+                              const Weights &weights,
+                              SurfaceDirection direction,
+                              vector<uint8_t> *directions)
+{
+    const long width = rasterWidth(elevationMatrix);
+    const long height = rasterHeight(elevationMatrix);
+    vector<double> surface(width * height, std::numeric_limits<double>::infinity());
+    if (directions)
+    {
+        directions->assign(width * height, 0);
     }
 
-    return finalMatrix;
-}
\ No newline at end of file
+    // Cells are queued by cost with the cheapest on top, and skipped if a cheaper cost was found since
+    using QueuedCell = std::pair<double, long>;
+    priority_queue<QueuedCell, vector<QueuedCell>, std::greater<QueuedCell>> cellQueue;
+
+    surface[origin.y * width + origin.x] = 0;
+    cellQueue.push({0, origin.y * width + origin.x});
+
+    vector<MatrixPoint> surroundingPoints(8, MatrixPoint{});
+    while (!cellQueue.empty())
+    {
+        const auto queued = cellQueue.top();
+        cellQueue.pop();
+        if (queued.first > surface[queued.second])
+        {
+            continue;
+        }
+
+        MatrixPoint currentPoint;
+        currentPoint.x = queued.second % width;
+        currentPoint.y = queued.second / width;
+
+        surroundingPoints.resize(8);
+        getSurroundingPoints(elevationMatrix, currentPoint, surroundingPoints);
+        for (const auto &neighbour : surroundingPoints)
+        {
+            const double step = surfaceStep(elevationMatrix, costMatrix, currentPoint, neighbour, weights, direction);
+
+            const long index = neighbour.y * width + neighbour.x;
+            if (queued.first + step < surface[index])
+            {
+                surface[index] = queued.first + step;
+                cellQueue.push({surface[index], index});
+                if (directions)
+                {
+                    (*directions)[index] = directionCode(currentPoint.x - neighbour.x, currentPoint.y - neighbour.y);
+                }
+            }
+        }
+    }
+
+    return surface;
+}
+
+/*
+ * Costs are never negative, and non-negative doubles order the same as their bit patterns,
+ * so the distance array is relaxed with a compare-and-swap on those bits.
+ */
+uint64_t costBits(double cost)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &cost, sizeof(bits));
+    return bits;
+}
+
+double bitsCost(uint64_t bits)
+{
+    double cost;
+    std::memcpy(&cost, &bits, sizeof(cost));
+    return cost;
+}
+
+// Lowers a cell's cost if the new one is cheaper. Returns true if it did.
+bool relaxCost(std::atomic<uint64_t> &cell, double cost)
+{
+    const uint64_t bits = costBits(cost);
+    uint64_t current = cell.load(std::memory_order_relaxed);
+    while (bits < current)
+    {
+        if (cell.compare_exchange_weak(current, bits, std::memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Typical steps per bucket of a delta-stepping search
+const double stepsPerBucket = 4;
+
+// Buckets a delta-stepping search keeps at once
+const size_t bucketWindow = 1024;
+
+// Cells sampled to estimate a typical step
+const long stepSamples = 4096;
+
+/*
+ * The median cost of a step, sampled over the raster, which sizes the rounds of the parallel searches.
+ * The median is used as cost layers can have a few very dear cells which would skew a mean.
+ * Returns 1 if no step costs anything.
+ */
+template <typename ElevationRaster, typename CostRaster>
+double typicalStep(const ElevationRaster &elevationMatrix, const CostRaster &costMatrix, const Weights &weights,
+                   SurfaceDirection direction)
+{
+    const long width = rasterWidth(elevationMatrix);
+    const long height = rasterHeight(elevationMatrix);
+
+    vector<double> sampledSteps;
+    vector<MatrixPoint> surroundingPoints(8, MatrixPoint{});
+    for (long i = 0; i < stepSamples; ++i)
+    {
+        MatrixPoint sample;
+        sample.x = (i * 7919) % width;
+        sample.y = (i * 104729) % height;
+        surroundingPoints.resize(8);
+        getSurroundingPoints(elevationMatrix, sample, surroundingPoints);
+        for (const auto &neighbour : surroundingPoints)
+        {
+            const double step = surfaceStep(elevationMatrix, costMatrix, sample, neighbour, weights, direction);
+            if (step > 0 && std::isfinite(step))
+            {
+                sampledSteps.push_back(step);
+            }
+        }
+    }
+    if (sampledSteps.empty())
+    {
+        return 1;
+    }
+
+    auto median = sampledSteps.begin() + sampledSteps.size() / 2;
+    std::nth_element(sampledSteps.begin(), median, sampledSteps.end());
+    return *median;
+}
+
+template <typename ElevationRaster, typename CostRaster>
+vector<double> getCostSurface(const ElevationRaster &elevationMatrix,
+                              const CostRaster &costMatrix,
+                              const MatrixPoint &origin,
+                              const Weights &weights,
+                              SurfaceDirection direction,
+                              ThreadPool &pool,
+                              vector<uint8_t> *directions)
+{
+    const long width = rasterWidth(elevationMatrix);
+    const long height = rasterHeight(elevationMatrix);
+    const long cells = width * height;
+
+    // Buckets span a few typical steps, so each phase has a wide frontier to share out
+    const double delta = stepsPerBucket * typicalStep(elevationMatrix, costMatrix, weights, direction);
+
+    std::unique_ptr<std::atomic<uint64_t>[]> costs(new std::atomic<uint64_t>[cells]);
+    pool.parallelFor(0, cells, [&](long first, long last)
+    {
+        for (long i = first; i < last; ++i)
+        {
+            costs[i].store(costBits(std::numeric_limits<double>::infinity()), std::memory_order_relaxed);
+        }
+    });
+
+    /*
+     * Each worker collects the cells it relaxes into its own buckets, which cover a window of
+     * bucketWindow buckets from windowStart. Steep steps can cost many orders of magnitude more
+     * than a typical one, so cells beyond the window wait in an overflow list, and once the window
+     * is empty it moves to start at the cheapest of them. By then most have been queued again
+     * more cheaply, and are dropped.
+     */
+    const long workers = pool.size();
+    vector<vector<vector<long>>> buckets(workers, vector<vector<long>>(bucketWindow));
+    vector<vector<long>> overflow(workers);
+    double windowStart = 0;
+    double windowEnd = bucketWindow * delta;
+    auto bucketOf = [&windowStart, delta](double cost)
+    {
+        return std::min<size_t>((size_t)((cost - windowStart) / delta), bucketWindow - 1);
+    };
+    auto push = [&](long worker, double cost, long index)
+    {
+        if (cost < windowEnd)
+        {
+            buckets[worker][bucketOf(cost)].push_back(index);
+        }
+        else
+        {
+            overflow[worker].push_back(index);
+        }
+    };
+
+    costs[origin.y * width + origin.x].store(costBits(0));
+    push(0, 0, origin.y * width + origin.x);
+
+    vector<long> frontier;
+    for (size_t bucket = 0;; )
+    {
+        // Moves to the lowest bucket any worker holds cells in
+        size_t lowest = bucketWindow;
+        for (const auto &own : buckets)
+        {
+            for (size_t b = bucket; b < lowest; ++b)
+            {
+                if (!own[b].empty())
+                {
+                    lowest = b;
+                }
+            }
+        }
+        if (lowest == bucketWindow)
+        {
+            // Moves the window to the cheapest cell beyond it which is still at the cost it was queued at
+            frontier.clear();
+            for (auto &own : overflow)
+            {
+                frontier.insert(frontier.end(), own.begin(), own.end());
+                own.clear();
+            }
+            std::sort(frontier.begin(), frontier.end());
+            frontier.erase(std::unique(frontier.begin(), frontier.end()), frontier.end());
+            frontier.erase(std::remove_if(frontier.begin(), frontier.end(), [&](long index)
+            {
+                return bitsCost(costs[index].load(std::memory_order_relaxed)) < windowEnd;
+            }), frontier.end());
+            if (frontier.empty())
+            {
+                break;
+            }
+
+            windowStart = std::numeric_limits<double>::infinity();
+            for (const long index : frontier)
+            {
+                windowStart = std::min(windowStart, bitsCost(costs[index].load(std::memory_order_relaxed)));
+            }
+            windowEnd = windowStart + bucketWindow * delta;
+            for (const long index : frontier)
+            {
+                push(0, bitsCost(costs[index].load(std::memory_order_relaxed)), index);
+            }
+            bucket = 0;
+            continue;
+        }
+        bucket = lowest;
+
+        // Relaxes the bucket until no cell falls back into it
+        while (true)
+        {
+            frontier.clear();
+            for (auto &own : buckets)
+            {
+                frontier.insert(frontier.end(), own[bucket].begin(), own[bucket].end());
+                own[bucket].clear();
+            }
+            if (frontier.empty())
+            {
+                break;
+            }
+
+            std::sort(frontier.begin(), frontier.end());
+            frontier.erase(std::unique(frontier.begin(), frontier.end()), frontier.end());
+
+            const long share = (frontier.size() + workers - 1) / workers;
+            pool.parallelFor(0, workers, [&](long firstWorker, long lastWorker)
+            {
+                vector<MatrixPoint> neighbours(8, MatrixPoint{});
+                for (long worker = firstWorker; worker < lastWorker; ++worker)
+                {
+                    const long end = std::min<long>(frontier.size(), (worker + 1) * share);
+                    for (long i = worker * share; i < end; ++i)
+                    {
+                        const long index = frontier[i];
+                        const double cost = bitsCost(costs[index].load(std::memory_order_relaxed));
+                        // Cells which have since become cheaper were also queued in a lower bucket
+                        if (bucketOf(cost) != bucket)
+                        {
+                            continue;
+                        }
+
+                        MatrixPoint currentPoint;
+                        currentPoint.x = index % width;
+                        currentPoint.y = index / width;
+                        neighbours.resize(8);
+                        getSurroundingPoints(elevationMatrix, currentPoint, neighbours);
+                        for (const auto &neighbour : neighbours)
+                        {
+                            const double step = surfaceStep(elevationMatrix, costMatrix, currentPoint, neighbour,
+                                                            weights, direction);
+                            const long neighbourIndex = neighbour.y * width + neighbour.x;
+                            if (relaxCost(costs[neighbourIndex], cost + step))
+                            {
+                                push(worker, cost + step, neighbourIndex);
+                            }
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    vector<double> surface(cells);
+    for (long i = 0; i < cells; ++i)
+    {
+        surface[i] = bitsCost(costs[i].load(std::memory_order_relaxed));
+    }
+
+    /*
+     * Each cell's direction points at the first cheaper neighbour whose cost plus the step
+     * gives its own. Free steps leave plateaus of equal cost, where pointing at any equal
+     * neighbour could make a cycle, so these are joined to the tree breadth first from
+     * the cells around them which already are.
+     */
+    if (directions)
+    {
+        directions->assign(cells, 0);
+        vector<char> joined(cells, 0);
+        joined[origin.y * width + origin.x] = 1;
+        auto leadsTo = [&](const MatrixPoint &cell, const MatrixPoint &next)
+        {
+            return surface[next.y * width + next.x]
+                   + surfaceStep(elevationMatrix, costMatrix, next, cell, weights, direction)
+                   == surface[cell.y * width + cell.x];
+        };
+
+        pool.parallelFor(0, height, [&](long firstRow, long lastRow)
+        {
+            for (long y = firstRow; y < lastRow; ++y)
+            {
+                for (long x = 0; x < width; ++x)
+                {
+                    const long index = y * width + x;
+                    if (joined[index] || !std::isfinite(surface[index]))
+                    {
+                        continue;
+                    }
+
+                    MatrixPoint cell;
+                    cell.x = x;
+                    cell.y = y;
+                    for (uint8_t code = 1; code <= 8; ++code)
+                    {
+                        MatrixPoint next;
+                        next.x = x + directionX[code];
+                        next.y = y + directionY[code];
+                        if (inBounds(elevationMatrix, next) && surface[next.y * width + next.x] < surface[index]
+                            && leadsTo(cell, next))
+                        {
+                            (*directions)[index] = code;
+                            joined[index] = 1;
+                            break;
+                        }
+                    }
+                }
+            }
+        });
+
+        deque<long> plateau;
+        for (long index = 0; index < cells; ++index)
+        {
+            if (!joined[index] && std::isfinite(surface[index]))
+            {
+                plateau.push_back(index);
+            }
+        }
+        // Starts from the plateau cells which border the tree, then spreads inwards
+        const size_t unjoined = plateau.size();
+        for (size_t i = 0; i < unjoined; ++i)
+        {
+            const long index = plateau.front();
+            plateau.pop_front();
+            MatrixPoint cell;
+            cell.x = index % width;
+            cell.y = index / width;
+            for (uint8_t code = 1; code <= 8 && !joined[index]; ++code)
+            {
+                MatrixPoint next;
+                next.x = cell.x + directionX[code];
+                next.y = cell.y + directionY[code];
+                if (inBounds(elevationMatrix, next) && joined[next.y * width + next.x] && leadsTo(cell, next))
+                {
+                    (*directions)[index] = code;
+                    joined[index] = 1;
+                    plateau.push_back(index);
+                }
+            }
+        }
+        while (!plateau.empty())
+        {
+            const long index = plateau.front();
+            plateau.pop_front();
+            MatrixPoint cell;
+            cell.x = index % width;
+            cell.y = index / width;
+            for (uint8_t code = 1; code <= 8; ++code)
+            {
+                MatrixPoint previous;
+                previous.x = cell.x + directionX[code];
+                previous.y = cell.y + directionY[code];
+                const long previousIndex = previous.y * width + previous.x;
+                if (inBounds(elevationMatrix, previous) && !joined[previousIndex]
+                    && std::isfinite(surface[previousIndex]) && leadsTo(previous, cell))
+                {
+                    // The step back from previous is the opposite direction, four codes round
+                    (*directions)[previousIndex] = (code + 3) % 8 + 1;
+                    joined[previousIndex] = 1;
+                    plateau.push_back(previousIndex);
+                }
+            }
+        }
+    }
+
+    return surface;
+}
+
+/*
+ * Cells are owned by the worker their 4 by 4 block hashes to. Blocks keep most
+ * successors with the worker which expanded them, while the hash scatters the
+ * frontier of any one region across every worker.
+ */
+long cellOwner(long x, long y, long workers)
+{
+    uint64_t block = (uint64_t)(x >> 2) * 0x9e3779b97f4a7c15ull ^ (uint64_t)(y >> 2) * 0xc2b2ae3d27d4eb4full;
+    block ^= block >> 31;
+    block *= 0xbf58476d1ce4e5b9ull;
+    block ^= block >> 29;
+    return (long)(block % (uint64_t)workers);
+}
+
+// A cell reached with a cost, sent to the worker which owns it
+struct SearchMessage
+{
+    long index;
+    long parent;
+    double cost;
+};
+
+// Expansions between sending buffered messages to other workers
+const int expansionsPerFlush = 64;
+
+/*
+ * How far, in typical steps, a worker may expand beyond the lowest estimate any worker holds.
+ * Workers far ahead of the others mostly expand cells which are later found cheaper and
+ * expanded again, which is most of the extra work of a parallel search when threads
+ * outnumber cores and some are not running.
+ */
+const double expansionWindowSteps = 2;
+
+// An idle worker yields this many times while polling for messages, then sleeps between polls
+const int idlePollsBeforeSleep = 64;
+const int idleSleepMicroseconds = 50;
+
+template <typename ElevationRaster, typename CostRaster>
+Route getShortestPath(const ElevationRaster &elevationMatrix,
+                      const CostRaster &costMatrix,
+                      deque<MatrixPoint> controlPoints,
+                      const Weights &weights,
+                      ThreadPool &pool,
+                      const CancellationToken *cancellation,
+                      SearchStats *stats)
+{
+    const long width = rasterWidth(elevationMatrix);
+    const long height = rasterHeight(elevationMatrix);
+    const long workers = pool.size();
+    const double infinity = std::numeric_limits<double>::infinity();
+
+    const double window = expansionWindowSteps * typicalStep(elevationMatrix, costMatrix, weights,
+                                                             SurfaceDirection::FromOrigin);
+
+    // Each cell is only ever written by its owner, so these need no synchronisation
+    vector<double> costs(width * height);
+    vector<long> parents(width * height);
+
+    // Set by the first worker to find the token cancelled or out of time, which stops every worker
+    std::atomic<SearchStatus> stopped(SearchStatus::Complete);
+    std::atomic<long> expanded(0);
+
+    const bool instrument = stats && stats->instrument;
+    if (instrument)
+    {
+        stats->legStats.clear();
+    }
+
+    Route route;
+    for (; controlPoints.size() >= 2; controlPoints.pop_front())
+    {
+        const MatrixPoint &start = controlPoints[0];
+        const MatrixPoint &target = controlPoints[1];
+        const long targetIndex = target.y * width + target.x;
+        const float targetHeight = rasterAt(elevationMatrix, target.x, target.y);
+
+        // Each worker's share of the leg, summed once it is done
+        vector<LegStats> workerStats(instrument ? workers : 0);
+        std::chrono::steady_clock::time_point legStart;
+        if (instrument)
+        {
+            legStart = std::chrono::steady_clock::now();
+        }
+
+        pool.parallelFor(0, width * height, [&](long first, long last)
+        {
+            std::fill(costs.begin() + first, costs.begin() + last, infinity);
+            std::fill(parents.begin() + first, parents.begin() + last, -1);
+        });
+
+        // The cheapest route to the target found so far, which stops anything dearer being expanded
+        std::atomic<uint64_t> incumbent(costBits(infinity));
+
+        // Messages in flight plus workers with something to do; the search is over when it reaches 0
+        std::atomic<long> work(workers);
+
+        using Batch = vector<SearchMessage>;
+        vector<MpscQueue<Batch>> inboxes(workers);
+
+        // Open lists hold (estimated total cost, cost, cell), cheapest estimate on top
+        using OpenCell = std::tuple<double, double, long>;
+        using OpenList = priority_queue<OpenCell, vector<OpenCell>, std::greater<OpenCell>>;
+        vector<OpenList> openLists(workers);
+
+        const long startIndex = start.y * width + start.x;
+        costs[startIndex] = 0;
+        if (startIndex == targetIndex)
+        {
+            incumbent.store(costBits(0));
+        }
+        else
+        {
+            const long owner = cellOwner(start.x, start.y, workers);
+            openLists[owner].emplace(0, 0, startIndex);
+            if (instrument)
+            {
+                workerStats[owner].pushes = 1;
+                workerStats[owner].peakOpen = 1;
+            }
+        }
+
+        // The lowest estimate in each worker's open list
+        std::unique_ptr<std::atomic<uint64_t>[]> frontiers(new std::atomic<uint64_t>[workers]);
+        for (long worker = 0; worker < workers; ++worker)
+        {
+            frontiers[worker].store(costBits(openLists[worker].empty() ? infinity
+                                                                       : std::get<0>(openLists[worker].top())));
+        }
+
+        pool.parallelFor(0, workers, [&](long worker, long)
+        {
+            auto &openList = openLists[worker];
+            vector<Batch> outboxes(workers);
+            vector<MatrixPoint> surroundingPoints(8, MatrixPoint{});
+            // Starts from the start cell's push, for the worker which owns it
+            LegStats counts = instrument ? workerStats[worker] : LegStats();
+            PhaseTimer timer;
+
+            // Takes a cost for one of this worker's cells, queueing it if it is an improvement
+            auto receive = [&](const SearchMessage &message)
+            {
+                if (message.cost >= costs[message.index])
+                {
+                    return;
+                }
+                costs[message.index] = message.cost;
+                parents[message.index] = message.parent;
+
+                if (message.index == targetIndex)
+                {
+                    relaxCost(incumbent, message.cost);
+                    return;
+                }
+
+                MatrixPoint cell;
+                cell.x = message.index % width;
+                cell.y = message.index / width;
+                const double heightToTarget = std::abs(targetHeight - rasterAt(elevationMatrix, cell.x, cell.y))
+                                              * (1 / weights.unitsPerPixel);
+                const double estimate = message.cost + distance(cell, target, heightToTarget, weights.heuristicXY,
+                                                                weights.heuristicXY, weights.heuristicZ);
+                if (estimate < bitsCost(incumbent.load(std::memory_order_relaxed)))
+                {
+                    openList.emplace(estimate, message.cost, message.index);
+                    if (instrument)
+                    {
+                        ++counts.pushes;
+                        counts.peakOpen = std::max(counts.peakOpen, (long)openList.size());
+                    }
+                }
+            };
+
+            auto flush = [&]()
+            {
+                for (long other = 0; other < workers; ++other)
+                {
+                    if (!outboxes[other].empty())
+                    {
+                        work.fetch_add(1);
+                        inboxes[other].push(std::move(outboxes[other]));
+                        outboxes[other] = Batch();
+                    }
+                }
+            };
+
+            bool active = true;
+            int idlePolls = 0;
+            long expandedHere = 0;
+            long nextCheck = 0;
+            while (stopped.load(std::memory_order_relaxed) == SearchStatus::Complete)
+            {
+                if (cancellation && expandedHere >= nextCheck)
+                {
+                    nextCheck = expandedHere + CancellationToken::checkInterval;
+                    SearchStatus running = SearchStatus::Complete;
+                    const SearchStatus status = cancellation->check();
+                    if (status != SearchStatus::Complete)
+                    {
+                        stopped.compare_exchange_strong(running, status);
+                        break;
+                    }
+                }
+
+                Batch batch;
+                while (inboxes[worker].tryPop(batch))
+                {
+                    if (!active)
+                    {
+                        work.fetch_add(1);
+                        active = true;
+                    }
+                    for (const auto &message : batch)
+                    {
+                        receive(message);
+                    }
+                    work.fetch_sub(1);
+                }
+
+                frontiers[worker].store(costBits(openList.empty() ? infinity : std::get<0>(openList.top())),
+                                        std::memory_order_relaxed);
+                double lowest = infinity;
+                for (long other = 0; other < workers; ++other)
+                {
+                    lowest = std::min(lowest, bitsCost(frontiers[other].load(std::memory_order_relaxed)));
+                }
+
+                int expansions = 0;
+                while (!openList.empty() && expansions < expansionsPerFlush
+                       && std::get<0>(openList.top()) <= lowest + window)
+                {
+                    timer.begin(instrument, expandedHere + expansions);
+                    const auto open = openList.top();
+                    openList.pop();
+                    timer.lap(counts.queueMilliseconds);
+                    const long index = std::get<2>(open);
+                    if (std::get<1>(open) > costs[index])
+                    {
+                        if (instrument)
+                        {
+                            ++counts.stalePops;
+                        }
+                        continue;
+                    }
+                    // Anything left is at least as dear as a route already found
+                    if (std::get<0>(open) >= bitsCost(incumbent.load(std::memory_order_relaxed)))
+                    {
+                        openList = OpenList();
+                        break;
+                    }
+
+                    MatrixPoint currentPoint;
+                    currentPoint.x = index % width;
+                    currentPoint.y = index / width;
+                    rasterPrefetch(elevationMatrix, currentPoint.x, currentPoint.y);
+                    rasterPrefetch(costMatrix, currentPoint.x, currentPoint.y);
+
+                    surroundingPoints.resize(8);
+                    getSurroundingPoints(elevationMatrix, currentPoint, surroundingPoints);
+                    for (const auto &successor : surroundingPoints)
+                    {
+                        timer.skip();
+                        const SearchMessage message = {
+                                successor.y * width + successor.x,
+                                index,
+                                costs[index] + surfaceStep(elevationMatrix, costMatrix, currentPoint, successor,
+                                                           weights, SurfaceDirection::FromOrigin)
+                        };
+                        timer.lap(counts.stepCostMilliseconds);
+                        const long owner = cellOwner(successor.x, successor.y, workers);
+                        if (owner == worker)
+                        {
+                            receive(message);
+                            timer.lap(counts.queueMilliseconds);
+                        }
+                        else
+                        {
+                            outboxes[owner].push_back(message);
+                        }
+                    }
+                    ++expansions;
+                }
+                // Cells from other workers are counted but not timed, as they arrive outside any expansion
+                timer.begin(false, 0);
+                expandedHere += expansions;
+                flush();
+
+                if (expansions > 0)
+                {
+                    idlePolls = 0;
+                    continue;
+                }
+                if (!openList.empty())
+                {
+                    // Waits for the workers behind it to catch up
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                if (active)
+                {
+                    active = false;
+                    work.fetch_sub(1);
+                }
+                if (work.load() == 0)
+                {
+                    break;
+                }
+                // Backs off when idle for long, so waiting threads leave the cores to those with work
+                if (++idlePolls < idlePollsBeforeSleep)
+                {
+                    std::this_thread::yield();
+                }
+                else
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(idleSleepMicroseconds));
+                }
+            }
+            expanded.fetch_add(expandedHere);
+            if (instrument)
+            {
+                counts.expanded = expandedHere;
+                workerStats[worker] = counts;
+            }
+        });
+
+        if (instrument)
+        {
+            LegStats leg;
+            leg.bytesAllocated = width * height * (long)(sizeof(costs[0]) + sizeof(parents[0]));
+            for (const auto &share : workerStats)
+            {
+                leg.expanded += share.expanded;
+                leg.pushes += share.pushes;
+                leg.stalePops += share.stalePops;
+                leg.peakOpen += share.peakOpen;
+                leg.stepCostMilliseconds += share.stepCostMilliseconds;
+                leg.queueMilliseconds += share.queueMilliseconds;
+            }
+            leg.bytesAllocated += leg.peakOpen * (long)sizeof(OpenCell);
+            leg.milliseconds = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - legStart).count();
+            stats->legStats.push_back(leg);
+        }
+
+        if (stopped.load() != SearchStatus::Complete)
+        {
+            break;
+        }
+
+        Leg leg = {{start.x, start.y}};
+        if (std::isfinite(costs[targetIndex]))
+        {
+            leg = {{target.x, target.y}};
+            // A valid chain of parents reaches the start, but a corrupt one must not loop forever
+            for (long index = parents[targetIndex]; index >= 0 && (long)leg.size() <= width * height;
+                 index = parents[index])
+            {
+                leg.push_back({index % width, index / width});
+            }
+            std::reverse(leg.begin(), leg.end());
+        }
+        route.push_back(std::move(leg));
+    }
+
+    if (stats)
+    {
+        stats->status = stopped.load();
+        stats->expanded = expanded.load();
+        stats->legs = route.size();
+    }
+
+    return route;
+}
+
+template <typename ElevationRaster, typename CostRaster>
+Matrix getCorridor(const ElevationRaster &elevationMatrix,
+                   const CostRaster &costMatrix,
+                   const deque<MatrixPoint> &controlPoints,
+                   const Weights &weights,
+                   double tolerance,
+                   ThreadPool &pool)
+{
+    const long width = rasterWidth(elevationMatrix);
+    const long height = rasterHeight(elevationMatrix);
+    Matrix corridor(height, vector<float>(width, -1));
+
+    for (size_t leg = 0; leg + 1 < controlPoints.size(); ++leg)
+    {
+        const auto &start = controlPoints[leg];
+        const auto &target = controlPoints[leg + 1];
+
+        vector<double> fromStart, toTarget;
+        pool.parallelFor(0, 2, [&](long first, long last)
+        {
+            for (long search = first; search < last; ++search)
+            {
+                if (search == 0)
+                {
+                    fromStart = getCostSurface(elevationMatrix, costMatrix, start, weights, SurfaceDirection::FromOrigin);
+                }
+                else
+                {
+                    toTarget = getCostSurface(elevationMatrix, costMatrix, target, weights, SurfaceDirection::ToOrigin);
+                }
+            }
+        });
+
+        const double optimal = fromStart[target.y * width + target.x];
+        // Sums taken in a different order may round a cell of the optimal route just past it
+        const double limit = optimal * (1 + tolerance + 1e-9);
+        pool.parallelFor(0, height, [&](long firstRow, long lastRow)
+        {
+            for (long y = firstRow; y < lastRow; ++y)
+            {
+                for (long x = 0; x < width; ++x)
+                {
+                    const double through = fromStart[y * width + x] + toTarget[y * width + x];
+                    if (through <= limit)
+                    {
+                        const float excess = optimal > 0 ? (float)(through / optimal - 1) : 0;
+                        auto &cell = corridor[y][x];
+                        cell = cell < 0 ? std::max(excess, 0.0f) : std::min(cell, std::max(excess, 0.0f));
+                    }
+                }
+            }
+        });
+    }
+
+    return corridor;
+}
+
+template Route getShortestPath(const Matrix &, const Matrix &,
+                               deque<MatrixPoint>, const Weights &, SearchProgress *,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const Matrix &, const QuantizedRaster<uint8_t> &,
+                               deque<MatrixPoint>, const Weights &, SearchProgress *,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const Matrix &, const QuantizedRaster<uint16_t> &,
+                               deque<MatrixPoint>, const Weights &, SearchProgress *,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const QuantizedRaster<uint16_t> &, const Matrix &,
+                               deque<MatrixPoint>, const Weights &, SearchProgress *,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const QuantizedRaster<uint16_t> &, const QuantizedRaster<uint8_t> &,
+                               deque<MatrixPoint>, const Weights &, SearchProgress *,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const QuantizedRaster<uint16_t> &, const QuantizedRaster<uint16_t> &,
+                               deque<MatrixPoint>, const Weights &, SearchProgress *,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const Matrix &, const TiledCostRaster &,
+                               deque<MatrixPoint>, const Weights &, SearchProgress *,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const TiledRaster &, const TiledCostRaster &,
+                               deque<MatrixPoint>, const Weights &, SearchProgress *,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const RasterView &, const RasterView &,
+                               deque<MatrixPoint>, const Weights &, SearchProgress *,
+                               const CancellationToken *, SearchStats *);
+
+template Route getShortestPath(const Matrix &, const Matrix &,
+                               deque<MatrixPoint>, const Weights &, ThreadPool &,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const Matrix &, const QuantizedRaster<uint8_t> &,
+                               deque<MatrixPoint>, const Weights &, ThreadPool &,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const Matrix &, const QuantizedRaster<uint16_t> &,
+                               deque<MatrixPoint>, const Weights &, ThreadPool &,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const QuantizedRaster<uint16_t> &, const Matrix &,
+                               deque<MatrixPoint>, const Weights &, ThreadPool &,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const QuantizedRaster<uint16_t> &, const QuantizedRaster<uint8_t> &,
+                               deque<MatrixPoint>, const Weights &, ThreadPool &,
+                               const CancellationToken *, SearchStats *);
+template Route getShortestPath(const QuantizedRaster<uint16_t> &, const QuantizedRaster<uint16_t> &,
+                               deque<MatrixPoint>, const Weights &, ThreadPool &,
+                               const CancellationToken *, SearchStats *);
+
+template double getRouteCost(const Matrix &, const Matrix &, const Route &, const Weights &);
+template double getRouteCost(const RasterView &, const RasterView &, const Route &, const Weights &);
+
+template vector<double> getCostSurface(const Matrix &, const Matrix &, const MatrixPoint &,
+                                       const Weights &, SurfaceDirection, vector<uint8_t> *);
+template vector<double> getCostSurface(const Matrix &, const Matrix &, const MatrixPoint &,
+                                       const Weights &, SurfaceDirection, ThreadPool &, vector<uint8_t> *);
+template Matrix getCorridor(const Matrix &, const Matrix &, const deque<MatrixPoint> &,
+                            const Weights &, double, ThreadPool &);
@@ -8,6 +8,7 @@
 #include <vector>
 #include <deque>
 #include <memory>
+#include <cstdint>
 
 /*
  * Stores all the information necessary to complete
@@ -37,17 +38,176 @@ struct Weights
     double heuristicZ;
 };
 
+/*
+ * Weights which give exactly the same search as these, so runs whose canonical
+ * weights match need only be searched once:
+ * a grade radius of 0 or a grade base of 1 both make every grade cost 1, and
+ * unitsPerPixel then only scales heights which are weighted 0.
+ */
+Weights canonicalWeights(Weights weights);
+
 // A 2D matrix of floats
 using Matrix = std::vector<std::vector<float>>;
 
+// A single raster cell
+struct Cell
+{
+    long x;
+    long y;
+};
+
+// The cells of one leg of a route, in order from its starting point to its target
+using Leg = std::vector<Cell>;
+
+// One leg for each consecutive pair of control points
+using Route = std::vector<Leg>;
+
+/*
+ * The search reads every raster through these functions.
+ * A Matrix is read directly. Any other raster type, such as a TiledRaster,
+ * provides width(), height(), at(x, y) and prefetch(x, y) members.
+ */
+inline long rasterWidth(const Matrix &matrix) { return matrix.empty() ? 0 : (long)matrix[0].size(); }
+inline long rasterHeight(const Matrix &matrix) { return (long)matrix.size(); }
+inline float rasterAt(const Matrix &matrix, long x, long y) { return matrix[y][x]; }
+inline void rasterPrefetch(const Matrix &, long, long) {}
+
+template <typename Raster> long rasterWidth(const Raster &raster) { return raster.width(); }
+template <typename Raster> long rasterHeight(const Raster &raster) { return raster.height(); }
+template <typename Raster> float rasterAt(const Raster &raster, long x, long y) { return raster.at(x, y); }
+template <typename Raster> void rasterPrefetch(const Raster &raster, long x, long y) { raster.prefetch(x, y); }
+
+class SearchProgress;
+class CancellationToken;
+struct SearchStats;
+
 /*
  * Using a set of weights, a set of points to pass through, a matrix of elevation
  * data, and a matrix of extra accumulated weighted data layers, computes the shortest
  * path between each consecutive point.
+ * Returns the cells of each leg in order. See PathOps.h for turning them into files.
+ * If progress is given, snapshots of the search are published to it as it runs.
+ * If cancellation is given, the search stops early when it is cancelled or its deadline
+ * passes, and returns only the legs it finished; stats, if given, says whether it did.
+ * See SearchControl.h.
+ * Instantiated for Matrix, TiledRaster, QuantizedRaster and RasterView inputs in breadcrumbs.cpp.
+ */
+template <typename ElevationRaster, typename CostRaster>
+Route getShortestPath(const ElevationRaster & elevationMatrix,
+                      const CostRaster & costMatrix,
+                      std::deque<MatrixPoint> controlPoints,
+                      const Weights &weights,
+                      SearchProgress * progress = nullptr,
+                      const CancellationToken * cancellation = nullptr,
+                      SearchStats * stats = nullptr);
+
+/*
+ * The cost of a route under the same cost model as getShortestPath: the sum over every step
+ * of its cost from getShortestPath's step function plus the cost layers at the cell stepped into.
+ * Instantiated for Matrix and RasterView inputs in breadcrumbs.cpp.
+ */
+template <typename ElevationRaster, typename CostRaster>
+double getRouteCost(const ElevationRaster & elevationMatrix,
+                    const CostRaster & costMatrix,
+                    const Route & route,
+                    const Weights & weights);
+
+class ThreadPool;
+
+/*
+ * The least-cost route between each consecutive pair of control points, found by
+ * hash-distributed A* (HDA*) on every thread of the pool. Each cell is owned by one
+ * thread, which alone keeps its cost in its own open list; successors owned by other
+ * threads are sent to them in batches through lock-free queues. A route to the target
+ * only stops the search once no thread holds a cell whose estimate could still beat it
+ * and no message is in flight, so the route is optimal whenever the heuristic never
+ * overestimates. getShortestPath above stops at the first route to reach the target,
+ * so the two can differ; where two routes tie, which is returned depends on timing.
+ * Steps whose cost would be negative are free, as in getCostSurface.
+ * Cancellation and stats work as for the search above.
+ * Must not be called from one of the pool's own tasks.
+ * Instantiated for Matrix and QuantizedRaster inputs in breadcrumbs.cpp.
+ */
+template <typename ElevationRaster, typename CostRaster>
+Route getShortestPath(const ElevationRaster & elevationMatrix,
+                      const CostRaster & costMatrix,
+                      std::deque<MatrixPoint> controlPoints,
+                      const Weights &weights,
+                      ThreadPool & pool,
+                      const CancellationToken * cancellation = nullptr,
+                      SearchStats * stats = nullptr);
+
+// Which way a cost surface accumulates
+enum class SurfaceDirection
+{
+    // The cost of reaching each cell from the origin
+    FromOrigin,
+    // The cost of reaching the origin from each cell
+    ToOrigin
+};
+
+/*
+ * The least accumulated cost between the origin and every cell, under the same
+ * cost model as getShortestPath, found by a full Dijkstra search.
+ * Returned row by row; cells which cannot be reached hold infinity.
+ * Steps whose cost would be negative, such as into nodata in a cost layer, are free.
+ * If directions is given, it is filled with the route tree: each cell's direction
+ * code for the next step of its best route towards the origin.
+ * Instantiated for Matrix inputs in breadcrumbs.cpp.
+ */
+template <typename ElevationRaster, typename CostRaster>
+std::vector<double> getCostSurface(const ElevationRaster & elevationMatrix,
+                                   const CostRaster & costMatrix,
+                                   const MatrixPoint & origin,
+                                   const Weights & weights,
+                                   SurfaceDirection direction,
+                                   std::vector<uint8_t> * directions = nullptr);
+
+/*
+ * The same cost surface and route tree as getCostSurface above, found in parallel by
+ * delta-stepping: cells are relaxed a bucket of similar costs at a time, with the bucket's
+ * cells shared between the pool's threads, each queueing the cells it improves in its own
+ * buckets. Costs are lowered with lock-free compare-and-swap, and the route tree is
+ * derived from the finished surface, so neither depends on the order threads ran in.
+ * Must not be called from one of the pool's own tasks.
+ */
+template <typename ElevationRaster, typename CostRaster>
+std::vector<double> getCostSurface(const ElevationRaster & elevationMatrix,
+                                   const CostRaster & costMatrix,
+                                   const MatrixPoint & origin,
+                                   const Weights & weights,
+                                   SurfaceDirection direction,
+                                   ThreadPool & pool,
+                                   std::vector<uint8_t> * directions = nullptr);
+
+/*
+ * Direction codes in a route tree. 0 marks the origin, or a cell which cannot reach it,
+ * and 1 to 8 give the neighbour one step closer to the origin, clockwise from north.
+ */
+const long directionX [] = {0, 0, 1, 1, 1, 0, -1, -1, -1};
+const long directionY [] = {0, -1, -1, 0, 1, 1, 1, 0, -1};
+
+/*
+ * Follows a width by height route tree from a cell to its origin, without searching.
+ * Returns the cells from the given cell to the origin, so a tree grown from the origin
+ * gives its route reversed. A cell which cannot reach the origin gives only itself.
+ */
+Leg followDirections(const std::vector<uint8_t> & directions, long width, long height, Cell from);
+
+/*
+ * The corridor of near-optimal routes between each consecutive pair of control points.
+ * Each leg sums a cost surface from its start with one to its target, which gives the
+ * cost of the best route through every cell; the two surfaces are found in parallel.
+ * Cells whose best route costs at most tolerance (e.g. 0.05 for 5%) more than the leg's
+ * optimum hold that excess as a fraction, so cells on the optimal route hold 0.
+ * Every other cell holds -1. Where legs overlap, the smaller excess is kept.
  */
-std::vector<std::vector<int>> getShortestPath(const Matrix & elevationMatrix,
-                                              const Matrix & costMatrix,
-                                              std::deque<MatrixPoint> controlPoints,
-                                              const Weights &weights);
+template <typename ElevationRaster, typename CostRaster>
+Matrix getCorridor(const ElevationRaster & elevationMatrix,
+                   const CostRaster & costMatrix,
+                   const std::deque<MatrixPoint> & controlPoints,
+                   const Weights & weights,
+                   double tolerance,
+                   ThreadPool & pool);
 
 #endif //BREADCRUMBS_BREADCRUMBS_H
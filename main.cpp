@@ -8,11 +8,33 @@
 #include <iostream>
 #include <string>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <deque>
 #include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <map>
+#include <cmath>
+#include <chrono>
+#include <csignal>
+#include <atomic>
+#include <type_traits>
+#include <limits>
 
 #include "json.hpp"
+#include "JsonOps.h"
 #include "TiffOps.h"
+#include "TiledRaster.h"
+#include "LayerExpression.h"
+#include "ThreadPool.h"
+#include "QuantizedRaster.h"
+#include "PathOps.h"
+#include "SweepArchive.h"
+#include "ParameterSweep.h"
+#include "RouteCache.h"
+#include "RouteRequests.h"
+#include "SearchControl.h"
 #include "breadcrumbs.h"
 
 using std::cout;
@@ -22,20 +44,6 @@ using std::string;
 using std::ifstream;
 using std::deque;
 
-// Adds each cell of a 2D matrix to an identically sized matrix.
-// The second parameter is added to the first parameter.
-template <typename T>
-void addMatrices(vector<vector<T>> &accumulatedLayers, const vector<vector<T>> &layer)
-{
-    for (size_t y = 0; y < layer.size(); ++y)
-    {
-        for (size_t x = 0; x < layer[0].size(); ++x)
-        {
-            accumulatedLayers[y][x] += layer[y][x];
-        }
-    }
-}
-
 // Stores various settings for the test suite function.
 // Cuts down on needed parameters
 struct TestSuiteSettings
@@ -43,180 +51,737 @@ struct TestSuiteSettings
     string filepath;
     bool heatmap = false;
     bool writeImages = false;
-    double unitsPerPixel = 0;
+    TiffCompression compression = TiffCompression::Deflate;
+    // When set, every run is written to this one file instead of a TIFF each
+    string sweepFile;
+    // When set, runs already in the cache are read instead of searched, and new runs are added to it
+    const RouteCache *cache = nullptr;
+    ContentHash request;
+    // When set, the sweep stops part way through a run once this is cancelled or out of time
+    const CancellationToken *cancellation = nullptr;
 };
 
+// Where a single route is written, and how
+struct OutputSettings
+{
+    vector<string> files;
+    TiffCompression compression = TiffCompression::Deflate;
+    // When set, the route is also stored in the cache under cacheKey
+    const RouteCache *cache = nullptr;
+    string cacheKey;
+    // When set, the search is instrumented and a report of it written here as JSON
+    string statsFile;
+    // Where the elevation's cells lie, read when a GeoJSON or GPX output needs it
+    GeoReference geoReference;
+    // When the program started, so the report can tell loading the rasters from searching
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+};
+
+// Why a search stopped early, for telling the user
+string stoppedReason(SearchStatus status)
+{
+    return status == SearchStatus::TimedOut ? "Search timed out" : "Search cancelled";
+}
+
 /*
- * Systematically runs the algorithm on a combination of parameter settings.
+ * Returns true if a search ran to the end. Otherwise says why it stopped and how far
+ * it got, and returns false, as nothing should be written for a route which is not whole.
+ */
+bool searchFinished(const SearchStats &stats)
+{
+    if (stats.status == SearchStatus::Complete)
+    {
+        return true;
+    }
+    cout << stoppedReason(stats.status) << " after expanding " << stats.expanded << " cells, with "
+         << stats.legs << " legs complete" << endl;
+    return false;
+}
+
+// The token an interrupt cancels while a route or sweep is searched
+std::atomic<CancellationToken *> interruptible{nullptr};
+static_assert(std::atomic<CancellationToken *>::is_always_lock_free, "the interrupt handler reads it");
+
+extern "C" void handleInterrupt(int)
+{
+    if (CancellationToken *cancellation = interruptible.load())
+    {
+        cancellation->cancel();
+    }
+    // A second interrupt ends the process straight away, as usual
+    std::signal(SIGINT, SIG_DFL);
+}
+
+// Makes an interrupt stop searching with the given token instead of ending the process
+void cancelOnInterrupt(CancellationToken &cancellation)
+{
+    interruptible.store(&cancellation);
+    std::signal(SIGINT, handleInterrupt);
+}
+
+/*
+ * Systematically runs the algorithm on each set of weights in a parameter sweep.
  * Each run is individually written to a TIFF with the parameter settings
- * encoded into the filename.
+ * encoded into the filename, or every run is written to one sweep file.
+ * Only distinct paths are stored, and runs whose weights give the same search
+ * as an earlier run's are not searched again. See SweepWriter.
+ * With a route cache, runs finished by an earlier, interrupted sweep are read from it.
  * The results of the test suite are written to a folder named after the points
  * that were traversed.
  * Optionally, generate a heatmap of every run and output to a single TIFF.
+ * If the settings' token is cancelled or out of time, the sweep stops part way through
+ * a run, keeping the runs before it, and returns -1.
+ * Throws std::runtime_error if the sweep file cannot be created or written.
  */
 int runTestSuite(const vector<std::vector<float>> &matrix, const vector<std::vector<float>> &costMatrix,
-                 deque<MatrixPoint> &points, const TestSuiteSettings &settings)
+                 deque<MatrixPoint> &points, const ParameterSweep &parameters, const TestSuiteSettings &settings)
 {
     auto heatMap = std::vector<vector<int>>(matrix.size(), vector<int>(matrix[0].size(), 0));
+    const int pathValue = 10;
+
+    std::unique_ptr<SweepWriter> sweep;
+    if (!settings.sweepFile.empty())
+    {
+        sweep = openSweepWriter(settings.sweepFile, rasterWidth(matrix), rasterHeight(matrix), settings.compression);
+    }
+    else if (settings.writeImages)
+    {
+        sweep = std::make_unique<SweepDirectoryWriter>(settings.filepath, rasterWidth(matrix), rasterHeight(matrix),
+                                                       settings.compression);
+    }
+
+    // The first run searched for each canonical set of weights
+    struct SearchedRun
+    {
+        Weights weights;
+        uint64_t fingerprint;
+        // Kept only when the heatmap needs it again
+        std::shared_ptr<const Route> route;
+    };
+    std::map<WeightsKey, SearchedRun> searched;
+    long cached = 0;
+
+    // Thrown out of a run whose search stopped early, to end the sweep
+    struct SweepStopped
+    {
+        SearchStats stats;
+    };
+    size_t runs = 0;
+    SearchStats stopped;
 
-    int gradeCosts [] = {0, 10, 100, 1000};
-    int xyzWeights [] = {0, 1, 10, 100};
-    for (const auto &gradeCost : gradeCosts)
     {
-        for (const int &movementCostXY : xyzWeights)
+        // Runs are written one after another in the background while later runs search
+        ThreadPool outputThread(1);
+
+        auto runOne = [&](const Weights &weights)
         {
-            for (const int &movementCostZ : xyzWeights)
+            const auto canonical = weightsKey(canonicalWeights(weights));
+            auto earlier = searched.find(canonical);
+            std::shared_ptr<const Route> route;
+            uint64_t fingerprint;
+            if (earlier != searched.end())
             {
-                for (const int &heuristicXY : xyzWeights)
+                route = earlier->second.route;
+                fingerprint = earlier->second.fingerprint;
+                if (sweep)
                 {
-                    for (const int &heuristicZ : xyzWeights)
+                    outputThread.submit([&sweep, weights, earlierWeights = earlier->second.weights]
                     {
-                        Weights weights = {
-                                settings.unitsPerPixel,
-                                gradeCost,
-                                5,
-                                static_cast<double>(movementCostXY),
-                                static_cast<double>(movementCostZ),
-                                static_cast<double>(heuristicXY),
-                                static_cast<double>(heuristicZ)
-                        };
-
-                        auto pathMatrix = getShortestPath(matrix, costMatrix, points, weights);
-
-                        if (settings.heatmap)
-                        {
-                            addMatrices<int>(heatMap, pathMatrix);
-                        }
+                        sweep->addSameAs(weights, earlierWeights);
+                    });
+                }
+            }
+            else
+            {
+                const string cacheKey = ContentHash(settings.request).add(canonicalWeights(weights)).hex();
+                Route found;
+                long width, height;
+                if (settings.cache && settings.cache->load(cacheKey, found, width, height))
+                {
+                    ++cached;
+                }
+                else
+                {
+                    SearchStats stats;
+                    found = getShortestPath(matrix, costMatrix, points, weights, nullptr,
+                                            settings.cancellation, &stats);
+                    if (stats.status != SearchStatus::Complete)
+                    {
+                        throw SweepStopped{stats};
+                    }
+                    if (settings.cache)
+                    {
+                        settings.cache->store(cacheKey, found, rasterWidth(matrix), rasterHeight(matrix));
+                    }
+                }
 
-                        if (settings.writeImages)
+                route = std::make_shared<const Route>(std::move(found));
+                fingerprint = routeFingerprint(*route);
+                searched[canonical] = {weights, fingerprint, settings.heatmap ? route : nullptr};
+                if (sweep)
+                {
+                    outputThread.submit([&sweep, weights, route]
+                    {
+                        if (!sweep->add(weights, *route))
                         {
-                            writePathToTIFF
-                            (
-                                pathMatrix,
-                                settings.filepath +
-                                "grade(" + std::to_string(gradeCost) + ")" +
-                                "g(xy=" + std::to_string(movementCostXY) + ", z=" + std::to_string(movementCostZ) + ")" +
-                                "h(xy=" + std::to_string(heuristicXY) + ", z=" + std::to_string(heuristicZ) + ").tif"
-                            );
+                            cout << "Error writing run " << sweepRunName(weights) << endl;
                         }
-                    }
+                    });
                 }
             }
+
+            if (settings.heatmap)
+            {
+                for (const auto &cell : distinctCells(*route))
+                {
+                    heatMap[cell.y][cell.x] += pathValue;
+                }
+            }
+
+            ++runs;
+            return fingerprint;
+        };
+
+        try
+        {
+            runs = parameters.run(runOne);
+        }
+        catch(SweepStopped &e)
+        {
+            stopped = e.stats;
         }
     }
 
+    // The runs finished are kept, even when the sweep stopped
+    if (sweep)
+    {
+        sweep->finish();
+    }
+
+    if (stopped.status != SearchStatus::Complete)
+    {
+        cout << stoppedReason(stopped.status) << " in run " << runs + 1 << " after expanding "
+             << stopped.expanded << " cells" << endl;
+    }
+    cout << "Runs: " << runs << ", searched: " << searched.size() - cached;
+    if (settings.cache)
+    {
+        cout << ", read from cache: " << cached;
+    }
+    if (sweep)
+    {
+        cout << ", distinct paths: " << sweep->pathCount();
+    }
+    cout << endl;
+
     if (settings.heatmap)
     {
-        writePathToTIFF(heatMap, settings.filepath + "heatmap.tif");
+        writePathToTIFF(heatMap, settings.filepath + "heatmap.tif", settings.compression);
     }
 
-    return 0;
+    return stopped.status == SearchStatus::Complete ? 0 : -1;
 }
 
 /*
- * Reads a JSON file with the given name into a JSON object.
+ * Reads the sweep run by the test suite out of the "sweep" object of params.json.
+ * Each field of Weights may be given as a number, a list of numbers, or a range
+ * {"from": a, "to": b, "count": n, "scale": "linear" or "log"}. Fields which are
+ * not given keep their value from the weights. "refinements" sets the rounds of
+ * adaptive refinement. Without a "sweep" object, the original fixed grid is run.
+ * Throws std::runtime_error for an invalid sweep.
  */
-nlohmann::json readJSON(const string& filename)
+ParameterSweep getSweep(const nlohmann::json &json)
 {
-    nlohmann::json root;
-    ifstream jsonFile(filename);
-    if (!jsonFile)
+    if (!json.contains("sweep"))
+    {
+        Weights base = {json["weights"]["unitsPerPixel"].get<double>(), 0, 5, 0, 0, 0, 0};
+        ParameterSweep sweep(base);
+        sweep.setAxis(WeightsField::GradeBase, {0, 10, 100, 1000});
+        for (auto field : {WeightsField::MovementCostXY, WeightsField::MovementCostZ,
+                           WeightsField::HeuristicXY, WeightsField::HeuristicZ})
+        {
+            sweep.setAxis(field, {0, 1, 10, 100});
+        }
+        return sweep;
+    }
+
+    const auto &sweepJson = json["sweep"];
+    ParameterSweep sweep(getWeights(json["weights"]));
+    for (int i = 0; i < weightsFieldCount; ++i)
     {
-        throw std::runtime_error("Error Reading Input from params.json");
+        const auto field = static_cast<WeightsField>(i);
+        const string name = weightsFieldName(field);
+        if (!sweepJson.contains(name))
+        {
+            continue;
+        }
+
+        const auto &axis = sweepJson[name];
+        if (axis.is_number())
+        {
+            sweep.setAxis(field, {axis.get<double>()});
+        }
+        else if (axis.is_array() && !axis.empty())
+        {
+            sweep.setAxis(field, axis.get<vector<double>>());
+        }
+        else if (axis.is_object() && axis.contains("from") && axis.contains("to"))
+        {
+            const double from = axis["from"].get<double>();
+            const double to = axis["to"].get<double>();
+            const int count = axis.value("count", 2);
+            const bool logarithmic = axis.value("scale", "linear") == "log";
+            if (count < 1 || (logarithmic && (from <= 0 || to <= 0)))
+            {
+                throw std::runtime_error("Invalid sweep range for " + name);
+            }
+
+            vector<double> values;
+            for (int step = 0; step < count; ++step)
+            {
+                const double t = count == 1 ? 0 : (double)step / (count - 1);
+                values.push_back(logarithmic ? from * std::pow(to / from, t) : from + (to - from) * t);
+            }
+            sweep.setAxis(field, values, logarithmic ? SweepScale::Logarithmic : SweepScale::Linear);
+        }
+        else
+        {
+            throw std::runtime_error("Invalid sweep values for " + name);
+        }
     }
-    jsonFile >> root;
-    return root;
+
+    sweep.setRefinements(sweepJson.value("refinements", 0));
+    return sweep;
 }
 
 /*
- * Reads, and weights, the extra cost layers specified in params.json.
+ * Hashes everything besides the weights which decides a route: the elevation and
+ * cost layer files' contents, each layer's weight and expression, the control points,
+ * and the bits the rasters are quantized to.
+ * Throws std::runtime_error if a file cannot be read.
  */
-vector<vector<vector<float>>> getLayers(const nlohmann::json& layersJson)
+ContentHash requestHash(const RouteCache &cache, const string &elevationFilename, const nlohmann::json &json,
+                        bool quantizeElevation, int costBits)
 {
-    std::vector<std::vector<vector<float>>> layers = std::vector<std::vector<vector<float>>>();
-    for (const auto & layerInfo : layersJson)
+    ContentHash hash;
+    hash.add(cache.fileDigest(elevationFilename));
+    for (const auto &layerInfo : json.value("layers", nlohmann::json::array()))
     {
-        auto layer = readTIFF(layerInfo["filename"]);
-        float layerWeight = layerInfo["weight"];
-        for (auto & row : layer)
+        const float layerWeight = layerInfo["weight"];
+        if (layerWeight != 0)
         {
-            for (auto & point : row)
-            {
-                point *= layerWeight;
-            }
+            hash.add(cache.fileDigest(layerInfo["filename"].get<string>()))
+                .add((double)layerWeight)
+                .add(layerInfo.value("expression", "value"));
         }
+    }
+
+    for (const auto &point : getControlPoints(json["points"]))
+    {
+        hash.add(point.x).add(point.y);
+    }
+
+    return hash.add((long)quantizeElevation).add((long)costBits);
+}
+
+// The most memory the process has held resident, in bytes
+long peakResidentBytes()
+{
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024L;
+#endif
+}
+
+using TimePoint = std::chrono::steady_clock::time_point;
 
-        layers.push_back(layer);
+double millisecondsBetween(TimePoint from, TimePoint to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+/*
+ * Writes the report asked for by --stats, if it was: the stats of the search, which ran from
+ * searchStart to searchEnd, the time spent loading before it and writing outputs after it,
+ * the process's peak resident memory, and anything in extra.
+ */
+void writeStatsReport(const OutputSettings &output, const SearchStats &stats, TimePoint searchStart,
+                      TimePoint searchEnd, const nlohmann::json &extra = nlohmann::json::object())
+{
+    if (output.statsFile.empty())
+    {
+        return;
     }
 
-    return layers;
+    auto report = searchStatsJson(stats);
+    report["loadMilliseconds"] = millisecondsBetween(output.started, searchStart);
+    report["searchMilliseconds"] = millisecondsBetween(searchStart, searchEnd);
+    report["writeMilliseconds"] = millisecondsBetween(searchEnd, std::chrono::steady_clock::now());
+    report["peakResidentBytes"] = peakResidentBytes();
+    report.update(extra);
+
+    std::ofstream file(output.statsFile);
+    file << report.dump(2) << endl;
+    if (!file)
+    {
+        cout << "Failed to write stats to " << output.statsFile << endl;
+    }
 }
 
 /*
- * Adds all cost layers, except the elevation data, into a single matrix.
+ * Writes a route to each requested output, or to path.tif if none were given,
+ * and to the route cache if there is one.
  */
-vector<vector<float>> accumulateLayers(vector<vector<vector<float>>> layers)
+void writeOutputs(const Route &route, long width, long height, const OutputSettings &output)
 {
-    vector<vector<float>> accumulatedLayers(layers[0].size(), vector<float>(layers[0][0].size(), 0));
-    for (const auto & layer : layers)
+    if (output.cache && !output.cacheKey.empty())
     {
-        addMatrices<float>(accumulatedLayers, layer);
+        output.cache->store(output.cacheKey, route, width, height);
     }
 
-    return accumulatedLayers;
+    if (output.files.empty())
+    {
+        writeRoute(route, width, height, "path.tif", output.compression);
+    }
+
+    for (const auto &file : output.files)
+    {
+        writeRoute(route, width, height, file, output.compression, &output.geoReference);
+    }
 }
 
+// Tile cache shared by the cost layers when only the costs are evaluated lazily
+const size_t lazyCostCacheBytes = 256ul * 1024 * 1024;
+
 /*
- * Read the weights out of the JSON object and into a Weights object.
+ * Opens every weighted cost layer given in params.json for lazy, per-cell evaluation,
+ * giving each layer a tile cache of bytesPerLayer.
+ * Throws std::runtime_error if a layer or its expression cannot be read.
  */
-Weights getWeights(const nlohmann::json &json)
+void addLazyLayers(TiledCostRaster &cost, const nlohmann::json &layersJson, size_t bytesPerLayer)
 {
-    return {
-            json["unitsPerPixel"].get<double>(),
-            json["grade"]["base"].get<int>(),
-            json["grade"]["radius"].get<int>(),
-            json["movementCost"]["xy"].get<double>(),
-            json["movementCost"]["z"].get<double>(),
-            json["heuristic"]["xy"].get<double>(),
-            json["heuristic"]["z"].get<double>()
+    for (const auto &layerInfo : layersJson)
+    {
+        const float layerWeight = layerInfo["weight"];
+        if (layerWeight == 0)
+        {
+            continue;
+        }
 
-    };
+        const string layerFilename = layerInfo["filename"];
+        auto layer = std::make_unique<TiledRaster>(layerFilename, bytesPerLayer);
+        if (!layer->isOpen() || layer->width() != cost.width() || layer->height() != cost.height())
+        {
+            throw std::runtime_error("Failed to read cost layer " + layerFilename);
+        }
+
+        cost.addLayer(std::move(layer), layerWeight, LayerExpression(layerInfo.value("expression", "value")));
+    }
 }
 
 /*
- * Calls all necessary functions to create an accumulated cost matrix for all cost layers
- * given in params.json
+ * Routes over an elevation TIFF, and cost layer TIFFs, without loading them into memory.
+ * Tiles are read on demand and the given number of bytes is shared between
+ * the tile caches of every raster.
  */
-vector<vector<float>> getCostMatrix(const Matrix &elevationMatrix, const nlohmann::json &layersJson)
+int routeOutOfCore(const string &elevationFilename, const string &paramsFilename, size_t cacheBytes,
+                   const OutputSettings &output, const CancellationToken &cancellation)
 {
-    std::vector<Matrix> layers;
-    if (layersJson.empty())
+    nlohmann::json json;
+    try
     {
-        layers = std::vector<std::vector<vector<float>>>(1, std::vector<vector<float>>(elevationMatrix.size(), vector<float>(elevationMatrix[0].size(), 0)));
+        json = readJSON(paramsFilename);
     }
-    else
+    catch(std::runtime_error &e)
+    {
+        cout << e.what() << endl;
+        return -1;
+    }
+
+    const size_t rasterCount = json["layers"].size() + 1;
+    TiledRaster elevation(elevationFilename, cacheBytes / rasterCount);
+    if (!elevation.isOpen())
     {
-        layers = getLayers(layersJson);
+        cout << "Failed to read TIFF " << elevationFilename << endl;
+        return -1;
     }
 
-    return accumulateLayers(layers);
+    cout << elevationFilename << endl;
+    cout << "Rows: " << elevation.height() << endl;
+    cout << "Columns: " << elevation.width() << endl;
+
+    TiledCostRaster cost(elevation.width(), elevation.height(),
+                         [&elevation](long x, long y) { return elevation.at(x, y); });
+    try
+    {
+        addLazyLayers(cost, json["layers"], cacheBytes / rasterCount);
+    }
+    catch(std::runtime_error &e)
+    {
+        cout << e.what() << endl;
+        return -1;
+    }
+
+    auto points = getControlPoints(json["points"]);
+    auto weights = getWeights(json["weights"]);
+
+    SearchStats stats;
+    stats.instrument = !output.statsFile.empty();
+    const auto searchStart = std::chrono::steady_clock::now();
+    auto route = getShortestPath(elevation, cost, points, weights, nullptr, &cancellation, &stats);
+    const auto searchEnd = std::chrono::steady_clock::now();
+
+    cout << "Tiles read: " << elevation.tilesRead() << endl;
+    cout << "Cost cells evaluated: " << cost.cellsEvaluated() << endl;
+    const nlohmann::json reads = {{"tilesRead", elevation.tilesRead()}, {"costCellsEvaluated", cost.cellsEvaluated()}};
+
+    if (!searchFinished(stats))
+    {
+        writeStatsReport(output, stats, searchStart, searchEnd, reads);
+        return -1;
+    }
+
+    writeOutputs(route, elevation.width(), elevation.height(), output);
+    writeStatsReport(output, stats, searchStart, searchEnd, reads);
+
+    return 0;
+}
+
+/*
+ * Reads the route for the weights in params.json out of a packed sweep archive
+ * and writes it to every output, without searching.
+ */
+int routeFromSweep(const string &archiveFilename, const string &paramsFilename, const OutputSettings &output)
+{
+    try
+    {
+        SweepArchive archive(archiveFilename);
+        const auto weights = getWeights(readJSON(paramsFilename)["weights"]);
+
+        Route route;
+        if (!archive.find(weights, route))
+        {
+            cout << "No run for " << sweepRunName(weights) << " in " << archiveFilename << endl;
+            return -1;
+        }
+
+        writeOutputs(route, archive.width(), archive.height(), output);
+    }
+    catch(std::runtime_error &e)
+    {
+        cout << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Finds the cost of reaching every cell from the source, and the route tree giving
+ * each cell's best route back to it, writing either or both to TIFFs.
+ */
+int writeCostSurface(const Matrix &elevation, const Matrix &cost, const MatrixPoint &source, const Weights &weights,
+                     const string &costSurfaceFile, const string &routeTreeFile, TiffCompression compression,
+                     ThreadPool &pool)
+{
+    const long width = rasterWidth(elevation);
+    const long height = rasterHeight(elevation);
+    vector<uint8_t> directions;
+    // With one thread, delta-stepping only adds overhead to the sequential search
+    const auto surface = pool.size() > 1
+            ? getCostSurface(elevation, cost, source, weights, SurfaceDirection::FromOrigin, pool,
+                             routeTreeFile.empty() ? nullptr : &directions)
+            : getCostSurface(elevation, cost, source, weights, SurfaceDirection::FromOrigin,
+                             routeTreeFile.empty() ? nullptr : &directions);
+
+    cout << "Reachable cells: "
+         << std::count_if(surface.begin(), surface.end(), [](double cell) { return std::isfinite(cell); }) << endl;
+
+    if (!costSurfaceFile.empty())
+    {
+        writeCostSurfaceToTIFF(surface, width, height, costSurfaceFile, compression);
+    }
+    if (!routeTreeFile.empty())
+    {
+        writeDirectionsToTIFF(directions, width, height, routeTreeFile, compression);
+    }
+
+    return 0;
 }
 
 /*
- * Reads the points which the algorithm must pass through from
- * the JSON object.
- * Returns a deque of MatrixPoints.
+ * Traces each control point after the first back through a route tree to its source,
+ * writing one leg per point to every output, without reading the rasters or searching.
  */
-deque<MatrixPoint> getControlPoints(const nlohmann::json &json)
+int routeFromTree(const string &treeFilename, const string &paramsFilename, const OutputSettings &output)
 {
+    long width = 0, height = 0;
+    const auto directions = readDirectionsTIFF(treeFilename, width, height);
+    if (directions.empty())
+    {
+        cout << "Failed to read route tree " << treeFilename << endl;
+        return -1;
+    }
+
     deque<MatrixPoint> points;
-    for (const auto & point : json)
+    try
+    {
+        points = getControlPoints(readJSON(paramsFilename)["points"]);
+    }
+    catch(std::runtime_error &e)
+    {
+        cout << e.what() << endl;
+        return -1;
+    }
+
+    Route route;
+    for (size_t i = 1; i < points.size(); ++i)
     {
-        MatrixPoint m = {point["x"].get<int>(), point["y"].get<int>()};
-        points.push_back(m);
+        if (points[i].x < 0 || points[i].y < 0 || points[i].x >= width || points[i].y >= height)
+        {
+            cout << "Point (" << points[i].x << ", " << points[i].y << ") is outside the route tree" << endl;
+            return -1;
+        }
+
+        auto leg = followDirections(directions, width, height, {points[i].x, points[i].y});
+        std::reverse(leg.begin(), leg.end());
+        route.push_back(std::move(leg));
     }
 
-    return points;
+    writeOutputs(route, width, height, output);
+    return 0;
+}
+
+/*
+ * Finds the corridor of routes within tolerance of the optimum for each leg,
+ * and writes it as a float TIFF to every output, or to corridor.tif if none were given.
+ */
+int writeCorridor(const Matrix &elevation, const Matrix &cost, const deque<MatrixPoint> &points,
+                  const Weights &weights, double tolerance, ThreadPool &pool, const OutputSettings &output)
+{
+    const auto corridor = getCorridor(elevation, cost, points, weights, tolerance, pool);
+
+    long cells = 0;
+    for (const auto &row : corridor)
+    {
+        cells += std::count_if(row.begin(), row.end(), [](float excess) { return excess >= 0; });
+    }
+    cout << "Corridor cells: " << cells << endl;
+
+    const vector<string> files = output.files.empty() ? vector<string>{"corridor.tif"} : output.files;
+    for (const auto &file : files)
+    {
+        writeMatrixToTIFF(corridor, file, output.compression);
+    }
+
+    return 0;
+}
+
+/*
+ * Routes over elevation and cost rasters in whichever storage was chosen
+ * and writes the result to every output. Returns -1, writing nothing, if the search was stopped.
+ */
+template <typename ElevationRaster, typename CostRaster>
+int routeAndWrite(const ElevationRaster &elevation, const CostRaster &cost,
+                  const deque<MatrixPoint> &points, const Weights &weights, const OutputSettings &output,
+                  ThreadPool *searchPool, const CancellationToken &cancellation)
+{
+    SearchStats stats;
+    stats.instrument = !output.statsFile.empty();
+    const auto searchStart = std::chrono::steady_clock::now();
+    auto route = searchPool ? getShortestPath(elevation, cost, points, weights, *searchPool, &cancellation, &stats)
+                            : getShortestPath(elevation, cost, points, weights, nullptr, &cancellation, &stats);
+    const auto searchEnd = std::chrono::steady_clock::now();
+    if (!searchFinished(stats))
+    {
+        writeStatsReport(output, stats, searchStart, searchEnd);
+        return -1;
+    }
+
+    writeOutputs(route, rasterWidth(elevation), rasterHeight(elevation), output);
+    writeStatsReport(output, stats, searchStart, searchEnd);
+    return 0;
+}
+
+/*
+ * Quantizes the cost matrix to 8 or 16-bit codes, or leaves it as floats for 0 bits,
+ * releasing the float matrix before routing. Routes with the parallel search if a pool is given.
+ * Returns -1 if the search was stopped.
+ */
+template <typename ElevationRaster>
+int routeQuantizedCost(const ElevationRaster &elevation, Matrix &costMatrix, int costBits,
+                       const deque<MatrixPoint> &points, const Weights &weights, const OutputSettings &output,
+                       ThreadPool *searchPool, const CancellationToken &cancellation)
+{
+    if (costBits == 8)
+    {
+        QuantizedRaster<uint8_t> cost(costMatrix);
+        Matrix().swap(costMatrix);
+        cout << "Cost quantization error: " << cost.maxError() << endl;
+        return routeAndWrite(elevation, cost, points, weights, output, searchPool, cancellation);
+    }
+    else if (costBits == 16)
+    {
+        QuantizedRaster<uint16_t> cost(costMatrix);
+        Matrix().swap(costMatrix);
+        cout << "Cost quantization error: " << cost.maxError() << endl;
+        return routeAndWrite(elevation, cost, points, weights, output, searchPool, cancellation);
+    }
+    else
+    {
+        return routeAndWrite(elevation, costMatrix, points, weights, output, searchPool, cancellation);
+    }
+}
+
+/*
+ * Parses the number given an option, which must be the whole of text.
+ * Throws std::runtime_error naming the option if it is not a number of the right kind.
+ */
+template <typename Number>
+Number parseNumber(const char *option, const string &text)
+{
+    const std::runtime_error invalid("Invalid value for " + string(option) + ": " + text);
+    size_t parsed = 0;
+    Number value;
+    try
+    {
+        if constexpr (std::is_floating_point_v<Number>)
+        {
+            value = (Number)std::stod(text, &parsed);
+            if (!std::isfinite(value))
+            {
+                throw invalid;
+            }
+        }
+        else
+        {
+            // stoull would wrap negative numbers around
+            if (std::is_unsigned_v<Number> && text.find('-') != string::npos)
+            {
+                throw invalid;
+            }
+            const long long number = std::stoll(text, &parsed);
+            if (number < (long long)std::numeric_limits<Number>::min() ||
+                (unsigned long long)number > (unsigned long long)std::numeric_limits<Number>::max())
+            {
+                throw invalid;
+            }
+            value = (Number)number;
+        }
+    }
+    catch(std::logic_error &)
+    {
+        // std::invalid_argument or std::out_of_range
+        throw invalid;
+    }
+    if (parsed != text.size())
+    {
+        throw invalid;
+    }
+    return value;
 }
 
 int main(int argc, char * argv [])
@@ -227,6 +792,216 @@ int main(int argc, char * argv [])
         return -1;
     }
 
+    TestSuiteSettings settings;
+    size_t tileCacheMegabytes = 0;
+    bool lazyCost = false;
+    bool quantizeElevation = false;
+    int costBits = 0;
+    string fromSweep;
+    string cacheDirectory;
+    double corridorPercent = -1;
+    string costSurfaceFile;
+    string routeTreeFile;
+    string fromRouteTree;
+    bool parallelSearch = false;
+    bool serve = false;
+    string batchFile;
+    string socketPath;
+    unsigned threads = 0;
+    double timeLimit = 0;
+    OutputSettings output;
+    try
+    {
+        for (int i = 3; i < argc; ++i)
+        {
+            if (strcmp(argv[i], "--testsuite") == 0)
+            {
+                settings.writeImages = true;
+            }
+            else if (strcmp(argv[i], "--heatmap") == 0)
+            {
+                settings.heatmap = true;
+            }
+            else if (strcmp(argv[i], "--tile-cache") == 0 && i + 1 < argc)
+            {
+                tileCacheMegabytes = parseNumber<size_t>("--tile-cache", argv[++i]);
+            }
+            else if (strcmp(argv[i], "--lazy-cost") == 0)
+            {
+                lazyCost = true;
+            }
+            else if (strcmp(argv[i], "--quantize-elevation") == 0)
+            {
+                quantizeElevation = true;
+            }
+            else if (strcmp(argv[i], "--quantize-cost") == 0 && i + 1 < argc)
+            {
+                costBits = parseNumber<int>("--quantize-cost", argv[++i]);
+                if (costBits != 8 && costBits != 16)
+                {
+                    throw std::runtime_error("--quantize-cost takes 8 or 16 bits");
+                }
+            }
+            else if (strcmp(argv[i], "--sweep-output") == 0 && i + 1 < argc)
+            {
+                settings.sweepFile = argv[++i];
+                settings.writeImages = true;
+            }
+            else if (strcmp(argv[i], "--from-sweep") == 0 && i + 1 < argc)
+            {
+                fromSweep = argv[++i];
+            }
+            else if (strcmp(argv[i], "--corridor") == 0 && i + 1 < argc)
+            {
+                corridorPercent = parseNumber<double>("--corridor", argv[++i]);
+            }
+            else if (strcmp(argv[i], "--cost-surface") == 0 && i + 1 < argc)
+            {
+                costSurfaceFile = argv[++i];
+            }
+            else if (strcmp(argv[i], "--route-tree") == 0 && i + 1 < argc)
+            {
+                routeTreeFile = argv[++i];
+            }
+            else if (strcmp(argv[i], "--from-route-tree") == 0 && i + 1 < argc)
+            {
+                fromRouteTree = argv[++i];
+            }
+            else if (strcmp(argv[i], "--parallel-search") == 0)
+            {
+                parallelSearch = true;
+            }
+            else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+            {
+                batchFile = argv[++i];
+            }
+            else if (strcmp(argv[i], "--serve") == 0)
+            {
+                serve = true;
+            }
+            else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+            {
+                socketPath = argv[++i];
+                serve = true;
+            }
+            else if (strcmp(argv[i], "--time-limit") == 0 && i + 1 < argc)
+            {
+                timeLimit = parseNumber<double>("--time-limit", argv[++i]);
+            }
+            else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            {
+                threads = parseNumber<unsigned>("--threads", argv[++i]);
+            }
+            else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            {
+                cacheDirectory = argv[++i];
+            }
+            else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc)
+            {
+                output.statsFile = argv[++i];
+            }
+            else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            {
+                output.files.emplace_back(argv[++i]);
+            }
+            else if (strcmp(argv[i], "--compression") == 0 && i + 1 < argc)
+            {
+                output.compression = parseTiffCompression(argv[++i]);
+                settings.compression = output.compression;
+            }
+        }
+    }
+    catch(std::runtime_error &e)
+    {
+        cout << e.what() << endl;
+        return -1;
+    }
+
+    // GeoJSON and GPX hold longitudes and latitudes, so refuse them before searching for a raster without them
+    const bool geographicOutput = std::any_of(output.files.begin(), output.files.end(), isGeographicOutput);
+    if (geographicOutput && (!readGeoReference(argv[1], output.geoReference) || !output.geoReference.geographic))
+    {
+        cout << "GeoJSON and GPX output need an elevation GeoTIFF in longitude and latitude, which "
+             << argv[1] << " is not" << endl;
+        return -1;
+    }
+
+    if (!batchFile.empty())
+    {
+        ThreadPool pool(threads);
+        return runBatch(argv[1], argv[2], batchFile, pool, timeLimit * 1000);
+    }
+
+    if (serve)
+    {
+        ThreadPool pool(threads);
+        return serveRoutes(argv[1], argv[2], socketPath, pool, timeLimit * 1000);
+    }
+
+    if (!fromSweep.empty())
+    {
+        return routeFromSweep(fromSweep, argv[2], output);
+    }
+
+    if (!fromRouteTree.empty())
+    {
+        return routeFromTree(fromRouteTree, argv[2], output);
+    }
+
+    const bool surfaceMode = !costSurfaceFile.empty() || !routeTreeFile.empty();
+
+    // Bounds the whole run from here, reading the rasters included, and is cancelled by an interrupt
+    CancellationToken cancellation(CancellationToken::deadlineAfter(timeLimit * 1000));
+    settings.cancellation = &cancellation;
+
+    std::unique_ptr<RouteCache> cache;
+    if (!cacheDirectory.empty())
+    {
+        try
+        {
+            cache = std::make_unique<RouteCache>(cacheDirectory);
+            auto json = readJSON(argv[2]);
+
+            // Out-of-core and lazy routing read the rasters unquantized
+            const bool unquantized = tileCacheMegabytes > 0 || lazyCost;
+            settings.cache = cache.get();
+            settings.request = requestHash(*cache, argv[1], json, false, 0);
+
+            output.cache = cache.get();
+            auto key = requestHash(*cache, argv[1], json, quantizeElevation && !unquantized,
+                                   unquantized ? 0 : costBits)
+                       .add(canonicalWeights(getWeights(json["weights"])));
+            // The parallel search finds least-cost routes, which the sequential one may not
+            if (parallelSearch && !unquantized)
+            {
+                key.add(string("parallel"));
+            }
+            output.cacheKey = key.hex();
+        }
+        catch(std::runtime_error &e)
+        {
+            cout << e.what() << endl;
+            return -1;
+        }
+
+        Route route;
+        long width, height;
+        if (!settings.writeImages && !settings.heatmap && corridorPercent < 0 && !surfaceMode
+            && cache->load(output.cacheKey, route, width, height))
+        {
+            cout << "Route read from cache" << endl;
+            output.cache = nullptr;
+            writeOutputs(route, width, height, output);
+            return 0;
+        }
+    }
+
+    if (tileCacheMegabytes > 0)
+    {
+        cancelOnInterrupt(cancellation);
+        return routeOutOfCore(argv[1], argv[2], tileCacheMegabytes * 1024 * 1024, output, cancellation);
+    }
+
     auto elevationMatrix = readTIFF(argv[1]);
 
     if (elevationMatrix.empty())
@@ -254,23 +1029,70 @@ int main(int argc, char * argv [])
 
     auto points = getControlPoints(json["points"]);
 
-    auto costMatrix = getCostMatrix(elevationMatrix, json["layers"]);
-
-    if (argc > 3)
+    if (lazyCost && !settings.writeImages && !settings.heatmap)
     {
-        TestSuiteSettings settings;
-        settings.unitsPerPixel = json["weights"]["unitsPerPixel"].get<double>();
-        for (int i = 3; i < argc; ++i)
+        TiledCostRaster cost(rasterWidth(elevationMatrix), rasterHeight(elevationMatrix),
+                             [&elevationMatrix](long x, long y) { return elevationMatrix[y][x]; });
+        try
         {
-            if (strcmp(argv[i], "--testsuite") == 0)
-            {
-                settings.writeImages = true;
-            } else if (strcmp(argv[i], "--heatmap") == 0)
-            {
-                settings.heatmap = true;
-            }
+            addLazyLayers(cost, json["layers"], lazyCostCacheBytes / std::max<size_t>(1, json["layers"].size()));
+        }
+        catch(std::runtime_error &e)
+        {
+            cout << e.what() << endl;
+            return -1;
         }
 
+        cancelOnInterrupt(cancellation);
+        SearchStats stats;
+        stats.instrument = !output.statsFile.empty();
+        const auto searchStart = std::chrono::steady_clock::now();
+        auto route = getShortestPath(elevationMatrix, cost, points, getWeights(json["weights"]), nullptr,
+                                     &cancellation, &stats);
+        const auto searchEnd = std::chrono::steady_clock::now();
+
+        cout << "Cost cells evaluated: " << cost.cellsEvaluated() << endl;
+        const nlohmann::json reads = {{"costCellsEvaluated", cost.cellsEvaluated()}};
+
+        if (!searchFinished(stats))
+        {
+            writeStatsReport(output, stats, searchStart, searchEnd, reads);
+            return -1;
+        }
+
+        writeOutputs(route, rasterWidth(elevationMatrix), rasterHeight(elevationMatrix), output);
+        writeStatsReport(output, stats, searchStart, searchEnd, reads);
+        return 0;
+    }
+
+    ThreadPool pool(threads);
+    Matrix costMatrix;
+    try
+    {
+        costMatrix = getCostMatrix(elevationMatrix, json["layers"], pool);
+    }
+    catch(std::runtime_error &e)
+    {
+        cout << e.what() << endl;
+        return -1;
+    }
+
+    if (surfaceMode)
+    {
+        return writeCostSurface(elevationMatrix, costMatrix, points.front(), getWeights(json["weights"]),
+                                costSurfaceFile, routeTreeFile, output.compression, pool);
+    }
+
+    if (corridorPercent >= 0)
+    {
+        return writeCorridor(elevationMatrix, costMatrix, points, getWeights(json["weights"]),
+                             corridorPercent / 100, pool, output);
+    }
+
+    cancelOnInterrupt(cancellation);
+
+    if (settings.writeImages || settings.heatmap)
+    {
         string dequeString;
         for (const auto &point : points)
         {
@@ -301,16 +1123,28 @@ int main(int argc, char * argv [])
             return -1;
         }
 
-        return runTestSuite(elevationMatrix, costMatrix, points, settings);
+        try
+        {
+            return runTestSuite(elevationMatrix, costMatrix, points, getSweep(json), settings);
+        }
+        catch(std::runtime_error &e)
+        {
+            cout << e.what() << endl;
+            return -1;
+        }
     }
-    else
+    else if (quantizeElevation)
     {
-        auto weights = getWeights(json["weights"]);
+        QuantizedRaster<uint16_t> elevation(elevationMatrix);
+        Matrix().swap(elevationMatrix);
+        cout << "Elevation quantization error: " << elevation.maxError() << endl;
 
-        auto pathMatrix = getShortestPath(elevationMatrix, costMatrix, points, weights);
-
-        writePathToTIFF(pathMatrix, "path.tif");
+        return routeQuantizedCost(elevation, costMatrix, costBits, points, getWeights(json["weights"]), output,
+                                  parallelSearch ? &pool : nullptr, cancellation);
+    }
+    else
+    {
+        return routeQuantizedCost(elevationMatrix, costMatrix, costBits, points, getWeights(json["weights"]),
+                                  output, parallelSearch ? &pool : nullptr, cancellation);
     }
-
-    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,590 @@
+//
+// Python module which lets analysts load rasters, accumulate cost layers and route from NumPy.
+//
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include "breadcrumbs.h"
+#include "RasterView.h"
+#include "TiffOps.h"
+#include "LayerExpression.h"
+#include "SearchControl.h"
+
+using std::string;
+using std::vector;
+using std::deque;
+
+/*
+ * Rasters are C-contiguous float32 arrays of shape (height, width). Arrays passed in are read
+ * in place through the buffer protocol, and arrays passed out wrap the memory the work filled,
+ * so neither is copied. Every function releases the GIL while it reads or searches, so many
+ * routes can run at once from a Python thread pool. Arrays passed in must not be changed by
+ * another thread until the call returns.
+ */
+
+// numpy.frombuffer, which wraps an object's buffer in an array without copying it
+PyObject *fromBuffer = nullptr;
+
+// Raised when a search is stopped by its timeout, with its status, expanded and legs
+PyObject *SearchStopped = nullptr;
+
+// Owns memory filled by a call and exports it as bytes, for NumPy arrays to be made over
+struct OwnedBuffer
+{
+    PyObject_HEAD
+    void *data;
+    Py_ssize_t bytes;
+    void (*destroy)(void *owner);
+    void *owner;
+};
+
+int ownedBufferGet(PyObject *object, Py_buffer *view, int flags)
+{
+    auto *buffer = reinterpret_cast<OwnedBuffer *>(object);
+    return PyBuffer_FillInfo(view, object, buffer->data, buffer->bytes, 0, flags);
+}
+
+void ownedBufferDealloc(PyObject *object)
+{
+    auto *buffer = reinterpret_cast<OwnedBuffer *>(object);
+    buffer->destroy(buffer->owner);
+    Py_TYPE(object)->tp_free(object);
+}
+
+PyBufferProcs ownedBufferProcs = {ownedBufferGet, nullptr};
+
+PyTypeObject OwnedBufferType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+/*
+ * Hands a vector over to a NumPy array of the given shape and dtype, which takes ownership of it.
+ * Returns null with a Python error set on failure.
+ */
+template <typename Cell>
+PyObject *handOver(std::unique_ptr<vector<Cell>> cells, const char *dtype, Py_ssize_t rows, Py_ssize_t columns)
+{
+    auto *buffer = PyObject_New(OwnedBuffer, &OwnedBufferType);
+    if (!buffer)
+    {
+        return nullptr;
+    }
+    buffer->data = cells->data();
+    buffer->bytes = cells->size() * sizeof(Cell);
+    buffer->owner = cells.release();
+    buffer->destroy = [](void *owner) { delete static_cast<vector<Cell> *>(owner); };
+
+    PyObject *flat = PyObject_CallFunction(fromBuffer, "Os", buffer, dtype);
+    Py_DECREF(buffer);
+    if (!flat)
+    {
+        return nullptr;
+    }
+    PyObject *array = PyObject_CallMethod(flat, "reshape", "nn", rows, columns);
+    Py_DECREF(flat);
+    return array;
+}
+
+// A raster passed in, read in place until released
+struct BorrowedRaster
+{
+    Py_buffer view = {};
+    const float *cells = nullptr;
+    long width = 0;
+    long height = 0;
+
+    BorrowedRaster() = default;
+    BorrowedRaster(const BorrowedRaster &) = delete;
+    BorrowedRaster &operator=(const BorrowedRaster &) = delete;
+
+    ~BorrowedRaster()
+    {
+        if (view.obj)
+        {
+            PyBuffer_Release(&view);
+        }
+    }
+};
+
+// Borrows a raster's cells. Returns false with a ValueError set if it is not a raster.
+bool borrowRaster(PyObject *object, const char *name, BorrowedRaster &raster)
+{
+    if (PyObject_GetBuffer(object, &raster.view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+    {
+        PyErr_Clear();
+    }
+    else
+    {
+        const char *format = raster.view.format ? raster.view.format : "B";
+        if (raster.view.ndim == 2 && raster.view.itemsize == 4
+            && (std::strcmp(format, "f") == 0 || std::strcmp(format, "=f") == 0 || std::strcmp(format, "<f") == 0)
+            && raster.view.shape[0] > 0 && raster.view.shape[1] > 0)
+        {
+            raster.cells = static_cast<const float *>(raster.view.buf);
+            raster.height = (long)raster.view.shape[0];
+            raster.width = (long)raster.view.shape[1];
+            return true;
+        }
+        PyBuffer_Release(&raster.view);
+        raster.view = {};
+    }
+
+    PyErr_Format(PyExc_ValueError, "%s must be a C-contiguous float32 array of shape (height, width); "
+                                   "numpy.ascontiguousarray(a, dtype=numpy.float32) makes one", name);
+    return false;
+}
+
+// A number in a dict, or false with an error set if it is missing or not a number
+bool getNumber(PyObject *dict, const char *key, const char *where, double &number)
+{
+    PyObject *value = PyDict_Check(dict) ? PyDict_GetItemString(dict, key) : nullptr;
+    if (!value)
+    {
+        PyErr_Format(PyExc_ValueError, "%s needs a number %s", where, key);
+        return false;
+    }
+    number = PyFloat_AsDouble(value);
+    return !PyErr_Occurred();
+}
+
+PyObject *getDict(PyObject *dict, const char *key)
+{
+    return PyDict_Check(dict) ? PyDict_GetItemString(dict, key) : nullptr;
+}
+
+// Reads weights in the form of params.json
+bool getWeights(PyObject *object, Weights &weights)
+{
+    double gradeBase, gradeRadius;
+    if (!getNumber(object, "unitsPerPixel", "weights", weights.unitsPerPixel)
+        || !getNumber(getDict(object, "grade"), "base", "weights grade", gradeBase)
+        || !getNumber(getDict(object, "grade"), "radius", "weights grade", gradeRadius)
+        || !getNumber(getDict(object, "movementCost"), "xy", "weights movementCost", weights.movementCostXY)
+        || !getNumber(getDict(object, "movementCost"), "z", "weights movementCost", weights.movementCostZ)
+        || !getNumber(getDict(object, "heuristic"), "xy", "weights heuristic", weights.heuristicXY)
+        || !getNumber(getDict(object, "heuristic"), "z", "weights heuristic", weights.heuristicZ))
+    {
+        return false;
+    }
+    weights.gradeBase = (int)gradeBase;
+    weights.gradeRadius = (int)gradeRadius;
+    return true;
+}
+
+// Reads points given as (x, y) pairs or as {"x": x, "y": y}, as in params.json
+bool getPoints(PyObject *object, long width, long height, deque<MatrixPoint> &points)
+{
+    PyObject *sequence = PySequence_Fast(object, "points must be a sequence of (x, y) pairs");
+    if (!sequence)
+    {
+        return false;
+    }
+
+    bool valid = true;
+    for (Py_ssize_t i = 0; valid && i < PySequence_Fast_GET_SIZE(sequence); ++i)
+    {
+        PyObject *item = PySequence_Fast_GET_ITEM(sequence, i);
+        double x = -1, y = -1;
+        if (PyDict_Check(item))
+        {
+            valid = getNumber(item, "x", "Each point", x) && getNumber(item, "y", "Each point", y);
+        }
+        else
+        {
+            PyObject *pair = PySequence_Fast(item, "Each point must be an (x, y) pair");
+            valid = pair && PySequence_Fast_GET_SIZE(pair) == 2;
+            if (valid)
+            {
+                x = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(pair, 0));
+                y = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(pair, 1));
+                valid = !PyErr_Occurred();
+            }
+            else if (pair)
+            {
+                PyErr_SetString(PyExc_ValueError, "Each point must be an (x, y) pair");
+            }
+            Py_XDECREF(pair);
+        }
+
+        // NaN would pass the range check, so it is ruled out first
+        if (valid && (!std::isfinite(x) || !std::isfinite(y)))
+        {
+            PyErr_SetString(PyExc_ValueError, "Point coordinates must be finite");
+            valid = false;
+        }
+        else if (valid && (x < 0 || y < 0 || x >= width || y >= height))
+        {
+            // Formatted as doubles, as casting one too large for a long is undefined
+            std::ostringstream point;
+            point << "Point (" << x << ", " << y << ") is outside the raster";
+            PyErr_SetString(PyExc_ValueError, point.str().data());
+            valid = false;
+        }
+        if (valid)
+        {
+            MatrixPoint point;
+            point.x = (long)x;
+            point.y = (long)y;
+            points.push_back(point);
+        }
+    }
+
+    Py_DECREF(sequence);
+    if (valid && points.size() < 2)
+    {
+        PyErr_SetString(PyExc_ValueError, "A route needs at least two points");
+        valid = false;
+    }
+    return valid;
+}
+
+// One cost layer, as in the layers list of params.json
+struct CostLayer
+{
+    string filename;
+    float weight;
+    string expression;
+};
+
+bool getLayers(PyObject *object, vector<CostLayer> &layers)
+{
+    PyObject *sequence = PySequence_Fast(object, "layers must be a sequence of dicts");
+    if (!sequence)
+    {
+        return false;
+    }
+
+    bool valid = true;
+    for (Py_ssize_t i = 0; valid && i < PySequence_Fast_GET_SIZE(sequence); ++i)
+    {
+        PyObject *item = PySequence_Fast_GET_ITEM(sequence, i);
+        PyObject *filename = getDict(item, "filename");
+        PyObject *expression = getDict(item, "expression");
+        double weight;
+        const char *text;
+        if (!filename || !(text = PyUnicode_AsUTF8(filename)))
+        {
+            if (!PyErr_Occurred())
+            {
+                PyErr_SetString(PyExc_ValueError, "Each layer needs a filename");
+            }
+            valid = false;
+        }
+        else if (getNumber(item, "weight", "Each layer", weight))
+        {
+            CostLayer layer = {text, (float)weight, "value"};
+            if (expression)
+            {
+                const char *source = PyUnicode_AsUTF8(expression);
+                valid = source != nullptr;
+                if (source)
+                {
+                    layer.expression = source;
+                }
+            }
+            layers.push_back(std::move(layer));
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    Py_DECREF(sequence);
+    return valid;
+}
+
+// Raises the error a C++ exception carried out of work done without the GIL
+PyObject *raise(const string &error)
+{
+    PyErr_SetString(PyExc_RuntimeError, error.c_str());
+    return nullptr;
+}
+
+PyDoc_STRVAR(readRasterDoc,
+"read_raster(filename)\n--\n\n"
+"Reads the first band of a TIFF into a float32 array of shape (height, width).");
+
+PyObject *readRaster(PyObject *, PyObject *args)
+{
+    const char *filename;
+    if (!PyArg_ParseTuple(args, "s", &filename))
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<vector<float>> cells;
+    long width = 0, height = 0;
+    string error;
+    Py_BEGIN_ALLOW_THREADS
+    try
+    {
+        const auto matrix = readTIFF(filename);
+        if (matrix.empty())
+        {
+            throw std::runtime_error(string("Failed to read TIFF ") + filename);
+        }
+        width = rasterWidth(matrix);
+        height = rasterHeight(matrix);
+        cells = std::make_unique<vector<float>>(width * height);
+        for (long y = 0; y < height; ++y)
+        {
+            std::copy(matrix[y].begin(), matrix[y].end(), cells->begin() + y * width);
+        }
+    }
+    catch(std::exception &e)
+    {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty())
+    {
+        return raise(error);
+    }
+    return handOver(std::move(cells), "float32", height, width);
+}
+
+PyDoc_STRVAR(buildCostRasterDoc,
+"build_cost_raster(elevation, layers)\n--\n\n"
+"The accumulated cost raster of a list of layers, each a dict with a filename, a weight\n"
+"and optionally an expression, as in the layers list of params.json.");
+
+PyObject *buildCostRaster(PyObject *, PyObject *args)
+{
+    PyObject *elevationObject, *layersObject;
+    if (!PyArg_ParseTuple(args, "OO", &elevationObject, &layersObject))
+    {
+        return nullptr;
+    }
+
+    BorrowedRaster elevation;
+    vector<CostLayer> layers;
+    if (!borrowRaster(elevationObject, "elevation", elevation) || !getLayers(layersObject, layers))
+    {
+        return nullptr;
+    }
+
+    const long width = elevation.width;
+    const long height = elevation.height;
+    auto cells = std::make_unique<vector<float>>(width * height, 0.0f);
+    string error;
+    Py_BEGIN_ALLOW_THREADS
+    try
+    {
+        // As main's getCostMatrix, streaming each layer through its expression into one raster
+        for (const auto &layer : layers)
+        {
+            if (layer.weight == 0)
+            {
+                continue;
+            }
+
+            accumulateLayer(layer.filename, LayerExpression(layer.expression), layer.weight,
+                            cells->data(), elevation.cells, width, height);
+        }
+    }
+    catch(std::exception &e)
+    {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty())
+    {
+        return raise(error);
+    }
+    return handOver(std::move(cells), "float32", height, width);
+}
+
+// Raises SearchStopped for a search which did not finish
+PyObject *raiseStopped(const SearchStats &stats)
+{
+    PyObject *error = PyObject_CallFunction(SearchStopped, "s", stats.status == SearchStatus::TimedOut
+                                                                ? "Search timed out" : "Search cancelled");
+    if (!error)
+    {
+        return nullptr;
+    }
+    PyObject *status = PyUnicode_FromString(searchStatusName(stats.status));
+    PyObject *expanded = PyLong_FromLong(stats.expanded);
+    PyObject *legs = PyLong_FromLong(stats.legs);
+    if (status && expanded && legs)
+    {
+        PyObject_SetAttrString(error, "status", status);
+        PyObject_SetAttrString(error, "expanded", expanded);
+        PyObject_SetAttrString(error, "legs", legs);
+        PyErr_SetObject(SearchStopped, error);
+    }
+    Py_XDECREF(status);
+    Py_XDECREF(expanded);
+    Py_XDECREF(legs);
+    Py_DECREF(error);
+    return nullptr;
+}
+
+PyDoc_STRVAR(routeDoc,
+"route(elevation, cost, points, weights, timeout=0)\n--\n\n"
+"The shortest route through each consecutive pair of points, as a dict holding\n"
+"\"legs\", an int32 array of (x, y) rows per leg, the route's total \"cost\", and the\n"
+"number of cells \"expanded\". cost may be None for no cost layers, points are (x, y)\n"
+"pairs or dicts as in params.json, and weights take the form of params.json.\n"
+"A timeout above 0 stops the search after that many milliseconds, raising SearchStopped.");
+
+PyObject *route(PyObject *, PyObject *args, PyObject *keywords)
+{
+    static const char *keywordNames[] = {"elevation", "cost", "points", "weights", "timeout", nullptr};
+    PyObject *elevationObject, *costObject, *pointsObject, *weightsObject;
+    double timeout = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "OOOO|d", const_cast<char **>(keywordNames),
+                                     &elevationObject, &costObject, &pointsObject, &weightsObject, &timeout))
+    {
+        return nullptr;
+    }
+
+    BorrowedRaster elevation;
+    BorrowedRaster cost;
+    deque<MatrixPoint> points;
+    Weights weights = {};
+    if (!borrowRaster(elevationObject, "elevation", elevation)
+        || (costObject != Py_None && !borrowRaster(costObject, "cost", cost))
+        || !getPoints(pointsObject, elevation.width, elevation.height, points)
+        || !getWeights(weightsObject, weights))
+    {
+        return nullptr;
+    }
+    if (cost.cells && (cost.width != elevation.width || cost.height != elevation.height))
+    {
+        PyErr_SetString(PyExc_ValueError, "The cost raster must be the same shape as the elevation");
+        return nullptr;
+    }
+
+    Route found;
+    SearchStats stats;
+    double routeCost = 0;
+    string error;
+    Py_BEGIN_ALLOW_THREADS
+    try
+    {
+        const RasterView elevationView(elevation.cells, elevation.width, elevation.height);
+        // Without a cost raster every cell costs nothing extra
+        vector<float> noCost;
+        if (!cost.cells)
+        {
+            noCost.assign(elevation.width * elevation.height, 0.0f);
+        }
+        const RasterView costView(cost.cells ? cost.cells : noCost.data(), elevation.width, elevation.height);
+
+        const CancellationToken cancellation(CancellationToken::deadlineAfter(timeout));
+        found = getShortestPath(elevationView, costView, points, weights, nullptr, &cancellation, &stats);
+        if (stats.status == SearchStatus::Complete)
+        {
+            routeCost = getRouteCost(elevationView, costView, found, weights);
+        }
+    }
+    catch(std::exception &e)
+    {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!error.empty())
+    {
+        return raise(error);
+    }
+    if (stats.status != SearchStatus::Complete)
+    {
+        return raiseStopped(stats);
+    }
+
+    PyObject *legs = PyList_New(found.size());
+    if (!legs)
+    {
+        return nullptr;
+    }
+    for (size_t i = 0; i < found.size(); ++i)
+    {
+        auto coordinates = std::make_unique<vector<int32_t>>();
+        coordinates->reserve(found[i].size() * 2);
+        for (const auto &cell : found[i])
+        {
+            coordinates->push_back((int32_t)cell.x);
+            coordinates->push_back((int32_t)cell.y);
+        }
+        PyObject *leg = handOver(std::move(coordinates), "int32", found[i].size(), 2);
+        if (!leg)
+        {
+            Py_DECREF(legs);
+            return nullptr;
+        }
+        PyList_SET_ITEM(legs, i, leg);
+    }
+
+    return Py_BuildValue("{s:N,s:d,s:l}", "legs", legs, "cost", routeCost, "expanded", stats.expanded);
+}
+
+PyMethodDef methods[] = {
+        {"read_raster", readRaster, METH_VARARGS, readRasterDoc},
+        {"build_cost_raster", buildCostRaster, METH_VARARGS, buildCostRasterDoc},
+        {"route", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(route)),
+         METH_VARARGS | METH_KEYWORDS, routeDoc},
+        {nullptr, nullptr, 0, nullptr}
+};
+
+PyModuleDef moduleDefinition = {
+        PyModuleDef_HEAD_INIT,
+        "breadcrumbs",
+        "Weighted shortest path trail layout over NumPy rasters.",
+        -1,
+        methods
+};
+
+PyMODINIT_FUNC PyInit_breadcrumbs()
+{
+    OwnedBufferType.tp_name = "breadcrumbs.OwnedBuffer";
+    OwnedBufferType.tp_basicsize = sizeof(OwnedBuffer);
+    OwnedBufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+    OwnedBufferType.tp_doc = "Memory filled by breadcrumbs, owned by the arrays made over it";
+    OwnedBufferType.tp_dealloc = ownedBufferDealloc;
+    OwnedBufferType.tp_as_buffer = &ownedBufferProcs;
+    if (PyType_Ready(&OwnedBufferType) < 0)
+    {
+        return nullptr;
+    }
+
+    PyObject *numpy = PyImport_ImportModule("numpy");
+    if (!numpy)
+    {
+        return nullptr;
+    }
+    fromBuffer = PyObject_GetAttrString(numpy, "frombuffer");
+    Py_DECREF(numpy);
+    if (!fromBuffer)
+    {
+        return nullptr;
+    }
+
+    PyObject *module = PyModule_Create(&moduleDefinition);
+    if (!module)
+    {
+        return nullptr;
+    }
+    SearchStopped = PyErr_NewExceptionWithDoc("breadcrumbs.SearchStopped",
+                                              "A search stopped by its timeout before finishing, with its status, "
+                                              "the cells it expanded and the legs it completed.",
+                                              PyExc_RuntimeError, nullptr);
+    Py_XINCREF(SearchStopped);
+    if (!SearchStopped || PyModule_AddObject(module, "SearchStopped", SearchStopped) < 0)
+    {
+        Py_XDECREF(SearchStopped);
+        Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}
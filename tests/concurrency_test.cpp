@@ -0,0 +1,103 @@
+//
+// Checks that the parallel searches give the answers of the sequential ones on glen_alps.tif:
+// the delta-stepping cost surface equals Dijkstra's, and the HDA* route costs the optimum.
+// Run with the number of threads to use.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "breadcrumbs.h"
+#include "TiffOps.h"
+#include "ThreadPool.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+/*
+ * The weights of the sample params, and with the steepest grade base of the default sweep,
+ * whose steps up steep ground cost up to 1e150. Both have a heuristic which never overestimates.
+ */
+const Weights testedWeights[] = {{1, 10, 5, 1, 1, 1, 1}, {1, 1000, 5, 1, 1, 1, 1}};
+
+// How far a route's cost summed step by step may be from the surface's, relative to its size
+constexpr double tolerance = 1e-9;
+
+bool nearlyEqual(double a, double b)
+{
+    return std::abs(a - b) <= tolerance * std::max(std::abs(a), std::abs(b));
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        cout << "Usage: concurrency_test <threads>" << endl;
+        return -1;
+    }
+    const unsigned threads = std::atoi(argv[1]);
+    if (threads == 0)
+    {
+        cout << "The thread count must be a positive number" << endl;
+        return -1;
+    }
+
+    const Matrix elevation = readTIFF(string(BREADCRUMBS_GALLERY) + "/glen_alps.tif");
+    if (elevation.empty())
+    {
+        cout << "Failed to read glen_alps.tif" << endl;
+        return -1;
+    }
+    const Matrix cost(elevation.size(), vector<float>(elevation[0].size(), 0.0f));
+    const MatrixPoint origin = {10, 10};
+    const MatrixPoint target = {300, 250};
+    ThreadPool pool(threads);
+    int failures = 0;
+
+    for (const auto &weights : testedWeights)
+    {
+        const auto sequential = getCostSurface(elevation, cost, origin, weights, SurfaceDirection::FromOrigin);
+        const auto parallel = getCostSurface(elevation, cost, origin, weights, SurfaceDirection::FromOrigin,
+                                             pool);
+        size_t differing = 0;
+        for (size_t i = 0; i < sequential.size(); i++)
+        {
+            if (sequential[i] != parallel[i])
+            {
+                differing++;
+            }
+        }
+        if (differing != 0)
+        {
+            cout << "Grade base " << weights.gradeBase << ": the delta-stepping surface differs from Dijkstra's in "
+                 << differing << " cells" << endl;
+            failures++;
+        }
+
+        const double optimum = sequential[target.y * rasterWidth(elevation) + target.x];
+        const Route route = getShortestPath(elevation, cost, {origin, target}, weights, pool);
+        if (route.size() != 1 || route[0].empty())
+        {
+            cout << "Grade base " << weights.gradeBase << ": HDA* found no route" << endl;
+            failures++;
+            continue;
+        }
+        const double routeCost = getRouteCost(elevation, cost, route, weights);
+        if (!nearlyEqual(routeCost, optimum))
+        {
+            cout << "Grade base " << weights.gradeBase << ": the HDA* route costs " << routeCost
+                 << ", but the optimum is " << optimum << endl;
+            failures++;
+        }
+        cout << "Grade base " << weights.gradeBase << ": route cost " << routeCost << endl;
+    }
+
+    cout << threads << " threads: " << (failures == 0 ? "passed" : "failed") << endl;
+    return failures == 0 ? 0 : -1;
+}
@@ -0,0 +1,26 @@
+{
+  "targets": [
+    {
+      "target_name": "breadcrumbs",
+      "sources": [
+        "native/breadcrumbs_addon.cpp",
+        "../breadcrumbs.cpp",
+        "../TiffOps.cpp",
+        "../TiledRaster.cpp",
+        "../LayerExpression.cpp",
+        "../PathOps.cpp",
+        "../SearchProgress.cpp",
+        "../ThreadPool.cpp"
+      ],
+      "include_dirs": [".."],
+      "cflags_cc": ["-std=c++17", "-O2", "-fexceptions"],
+      "cflags_cc!": ["-fno-exceptions", "-fno-rtti"],
+      "libraries": ["-ltiff", "-lz", "-lpthread"],
+      "xcode_settings": {
+        "CLANG_CXX_LANGUAGE_STANDARD": "c++17",
+        "GCC_ENABLE_CPP_EXCEPTIONS": "YES",
+        "OTHER_CPLUSPLUSFLAGS": ["-O2"]
+      }
+    }
+  ]
+}
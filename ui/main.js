@@ -1,5 +1,22 @@
 const { app, BrowserWindow, ipcMain } = require("electron")
 const path = require("path")
+const breadcrumbs = require("./build/Release/breadcrumbs.node")
+
+// Elevation rasters already read, by filename, so routing again over the same terrain does not reread it
+const rasters = new Map()
+
+// How many expansions between progress reports, and how often the window is sent the newest
+const progressInterval = 65536
+const progressMilliseconds = 100
+
+const readRaster = filename => {
+  if (!rasters.has(filename)) {
+    const raster = breadcrumbs.readRaster(filename)
+    raster.catch(() => rasters.delete(filename))
+    rasters.set(filename, raster)
+  }
+  return rasters.get(filename)
+}
 
 const createWindow = () => {
   const win = new BrowserWindow({
@@ -10,8 +27,34 @@ const createWindow = () => {
     }
   })
 
-  ipcMain.on('generateRoute', (event, formData) => {
-    
+  // The search running now, which a newer request or the cancel button stops
+  let currentSearch = null
+
+  ipcMain.on('cancelRoute', () => {
+    if (currentSearch) breadcrumbs.cancel(currentSearch)
+  })
+
+  ipcMain.on('generateRoute', async (event, params) => {
+    if (currentSearch) breadcrumbs.cancel(currentSearch)
+    const cancellation = breadcrumbs.createCancellation()
+    currentSearch = cancellation
+    const progress = breadcrumbs.createProgress(progressInterval)
+    const reportProgress = () => {
+      const snapshot = breadcrumbs.readProgress(progress)
+      if (snapshot) event.reply('routeProgress', snapshot)
+    }
+    const timer = setInterval(reportProgress, progressMilliseconds)
+    try {
+      const elevation = await readRaster(params.elevation)
+      const route = await breadcrumbs.route(elevation, null, params.points, params.weights, progress, cancellation)
+      event.reply('routeGenerated', route)
+    } catch (error) {
+      // A search stopped for a newer one has nothing to report
+      if (currentSearch === cancellation) event.reply('routeFailed', error.message)
+    } finally {
+      clearInterval(timer)
+      if (currentSearch === cancellation) currentSearch = null
+    }
   })
 
   win.loadFile('index.html')
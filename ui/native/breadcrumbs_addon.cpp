@@ -0,0 +1,774 @@
+//
+// Node-API binding which lets the UI load rasters and route in-process.
+//
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+#include <node_api.h>
+#include "breadcrumbs.h"
+#include "RasterView.h"
+#include "TiffOps.h"
+#include "LayerExpression.h"
+#include "SearchProgress.h"
+#include "SearchControl.h"
+
+using std::string;
+using std::vector;
+using std::deque;
+
+/*
+ * Every function here runs its work on a libuv worker thread and returns a promise.
+ * A raster is an object {width, height, cells} with cells a Float32Array of width * height
+ * values, row by row. Rasters passed in are read in place, so they must not be changed
+ * until the promise settles. Rasters and routes passed out are backed by the buffers
+ * the work filled, handed over without copying where the runtime allows it.
+ */
+
+// A raster handed in from JavaScript, held alive until the work using it completes
+struct BorrowedRaster
+{
+    napi_ref reference = nullptr;
+    const float *cells = nullptr;
+    long width = 0;
+    long height = 0;
+};
+
+// One cost layer, as in the layers list of params.json
+struct CostLayer
+{
+    string filename;
+    float weight;
+    string expression;
+};
+
+// Throws a JavaScript error and returns null, for returning from a binding straight away
+napi_value throwError(napi_env env, const string &message)
+{
+    napi_throw_error(env, nullptr, message.c_str());
+    return nullptr;
+}
+
+napi_value rejectWith(napi_env env, napi_deferred deferred, const string &message)
+{
+    napi_value text, error;
+    napi_create_string_utf8(env, message.c_str(), message.size(), &text);
+    napi_create_error(env, nullptr, text, &error);
+    napi_reject_deferred(env, deferred, error);
+    return nullptr;
+}
+
+bool getProperty(napi_env env, napi_value object, const char *name, napi_value &value)
+{
+    bool present = false;
+    return napi_has_named_property(env, object, name, &present) == napi_ok && present
+           && napi_get_named_property(env, object, name, &value) == napi_ok;
+}
+
+bool getNumber(napi_env env, napi_value object, const char *name, double &number)
+{
+    napi_value value;
+    return getProperty(env, object, name, value) && napi_get_value_double(env, value, &number) == napi_ok;
+}
+
+bool getString(napi_env env, napi_value value, string &text)
+{
+    size_t length = 0;
+    if (napi_get_value_string_utf8(env, value, nullptr, 0, &length) != napi_ok)
+    {
+        return false;
+    }
+    text.resize(length + 1);
+    napi_get_value_string_utf8(env, value, &text[0], text.size(), &length);
+    text.resize(length);
+    return true;
+}
+
+// Reads a raster object without copying its cells. Returns false if it is not one.
+bool borrowRaster(napi_env env, napi_value object, BorrowedRaster &raster)
+{
+    double width, height;
+    napi_value cells;
+    if (!getNumber(env, object, "width", width) || !getNumber(env, object, "height", height)
+        || !getProperty(env, object, "cells", cells))
+    {
+        return false;
+    }
+
+    bool isTypedArray = false;
+    napi_typedarray_type type;
+    size_t length;
+    void *data;
+    if (napi_is_typedarray(env, cells, &isTypedArray) != napi_ok || !isTypedArray
+        || napi_get_typedarray_info(env, cells, &type, &length, &data, nullptr, nullptr) != napi_ok
+        || type != napi_float32_array || width < 1 || height < 1 || (double)length != width * height)
+    {
+        return false;
+    }
+
+    raster.cells = static_cast<const float *>(data);
+    raster.width = (long)width;
+    raster.height = (long)height;
+    return napi_create_reference(env, cells, 1, &raster.reference) == napi_ok;
+}
+
+void release(napi_env env, BorrowedRaster &raster)
+{
+    if (raster.reference)
+    {
+        napi_delete_reference(env, raster.reference);
+        raster.reference = nullptr;
+    }
+}
+
+/*
+ * Wraps a vector's storage in an ArrayBuffer, which takes ownership of it.
+ * Runtimes which do not allow buffers from outside their own heap, such as
+ * Electron with its memory cage, get a copy instead.
+ */
+template <typename Cell>
+napi_value handOver(napi_env env, std::unique_ptr<vector<Cell>> cells)
+{
+    napi_value buffer;
+    vector<Cell> *owned = cells.get();
+    const size_t bytes = owned->size() * sizeof(Cell);
+    if (napi_create_external_arraybuffer(env, owned->data(), bytes,
+                                         [](napi_env, void *, void *hint) { delete static_cast<vector<Cell> *>(hint); },
+                                         owned, &buffer) == napi_ok)
+    {
+        cells.release();
+        return buffer;
+    }
+
+    void *data;
+    napi_create_arraybuffer(env, bytes, &data, &buffer);
+    std::memcpy(data, owned->data(), bytes);
+    return buffer;
+}
+
+napi_value rasterObject(napi_env env, std::unique_ptr<vector<float>> cells, long width, long height)
+{
+    const size_t length = cells->size();
+    napi_value buffer = handOver(env, std::move(cells));
+    napi_value array, object, number;
+    napi_create_typedarray(env, napi_float32_array, length, buffer, 0, &array);
+    napi_create_object(env, &object);
+    napi_create_int64(env, width, &number);
+    napi_set_named_property(env, object, "width", number);
+    napi_create_int64(env, height, &number);
+    napi_set_named_property(env, object, "height", number);
+    napi_set_named_property(env, object, "cells", array);
+    return object;
+}
+
+// A leg's cells as an Int32Array of x, y pairs
+napi_value legArray(napi_env env, const Leg &leg)
+{
+    auto coordinates = std::make_unique<vector<int32_t>>();
+    coordinates->reserve(leg.size() * 2);
+    for (const auto &cell : leg)
+    {
+        coordinates->push_back((int32_t)cell.x);
+        coordinates->push_back((int32_t)cell.y);
+    }
+    const size_t length = coordinates->size();
+    napi_value array;
+    napi_create_typedarray(env, napi_int32_array, length, handOver(env, std::move(coordinates)), 0, &array);
+    return array;
+}
+
+/*
+ * The state of one piece of work from the call to its promise settling.
+ * run() happens on a worker thread and must not touch JavaScript. Back on the
+ * main thread, releaseInputs() is always called, then settle() if run() succeeded.
+ */
+struct Work
+{
+    virtual ~Work() = default;
+    virtual void run() = 0;
+    virtual void releaseInputs(napi_env) {}
+    virtual napi_value settle(napi_env env) = 0;
+
+    napi_async_work work = nullptr;
+    napi_deferred deferred = nullptr;
+    string error;
+};
+
+// Queues work on the libuv pool and returns its promise
+napi_value queue(napi_env env, std::unique_ptr<Work> work, const char *name)
+{
+    napi_value promise, resourceName;
+    napi_create_promise(env, &work->deferred, &promise);
+    napi_create_string_utf8(env, name, NAPI_AUTO_LENGTH, &resourceName);
+
+    auto execute = [](napi_env, void *data)
+    {
+        auto *work = static_cast<Work *>(data);
+        try
+        {
+            work->run();
+        }
+        catch(std::exception &e)
+        {
+            work->error = e.what();
+        }
+    };
+    auto complete = [](napi_env env, napi_status, void *data)
+    {
+        std::unique_ptr<Work> work(static_cast<Work *>(data));
+        napi_delete_async_work(env, work->work);
+        work->releaseInputs(env);
+        if (!work->error.empty())
+        {
+            rejectWith(env, work->deferred, work->error);
+            return;
+        }
+        napi_value result = work->settle(env);
+        if (result)
+        {
+            napi_resolve_deferred(env, work->deferred, result);
+        }
+    };
+
+    napi_create_async_work(env, nullptr, resourceName, execute, complete, work.get(), &work->work);
+    napi_queue_async_work(env, work->work);
+    work.release();
+    return promise;
+}
+
+struct ReadRasterWork : Work
+{
+    string filename;
+    std::unique_ptr<vector<float>> cells;
+    long width = 0;
+    long height = 0;
+
+    void run() override
+    {
+        const auto matrix = readTIFF(filename);
+        if (matrix.empty())
+        {
+            throw std::runtime_error("Failed to read TIFF " + filename);
+        }
+
+        width = rasterWidth(matrix);
+        height = rasterHeight(matrix);
+        cells = std::make_unique<vector<float>>(width * height);
+        for (long y = 0; y < height; ++y)
+        {
+            std::copy(matrix[y].begin(), matrix[y].end(), cells->begin() + y * width);
+        }
+    }
+
+    napi_value settle(napi_env env) override
+    {
+        return rasterObject(env, std::move(cells), width, height);
+    }
+};
+
+// readRaster(filename) resolves to the TIFF's first band as a raster
+napi_value readRaster(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value argv[1];
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+
+    auto work = std::make_unique<ReadRasterWork>();
+    if (argc < 1 || !getString(env, argv[0], work->filename))
+    {
+        return throwError(env, "readRaster expects a filename");
+    }
+    return queue(env, std::move(work), "breadcrumbs.readRaster");
+}
+
+struct CostRasterWork : Work
+{
+    BorrowedRaster elevation;
+    vector<CostLayer> layers;
+    std::unique_ptr<vector<float>> cells;
+
+    // As main's getCostMatrix, streaming each layer through its expression into one raster
+    void run() override
+    {
+        const long width = elevation.width;
+        const long height = elevation.height;
+        cells = std::make_unique<vector<float>>(width * height, 0.0f);
+        for (const auto &layer : layers)
+        {
+            if (layer.weight == 0)
+            {
+                continue;
+            }
+
+            accumulateLayer(layer.filename, LayerExpression(layer.expression), layer.weight,
+                            cells->data(), elevation.cells, width, height);
+        }
+    }
+
+    void releaseInputs(napi_env env) override
+    {
+        release(env, elevation);
+    }
+
+    napi_value settle(napi_env env) override
+    {
+        return rasterObject(env, std::move(cells), elevation.width, elevation.height);
+    }
+};
+
+/*
+ * buildCostRaster(elevation, layers) resolves to the accumulated cost raster of a list
+ * of layers, each {filename, weight, expression}, as in the layers list of params.json.
+ */
+napi_value buildCostRaster(napi_env env, napi_callback_info info)
+{
+    size_t argc = 2;
+    napi_value argv[2];
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+
+    auto work = std::make_unique<CostRasterWork>();
+    bool isArray = false;
+    if (argc < 2 || napi_is_array(env, argv[1], &isArray) != napi_ok || !isArray)
+    {
+        return throwError(env, "buildCostRaster expects an elevation raster and a list of layers");
+    }
+
+    uint32_t count;
+    napi_get_array_length(env, argv[1], &count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        napi_value layerObject, value;
+        napi_get_element(env, argv[1], i, &layerObject);
+        CostLayer layer;
+        double weight;
+        if (!getProperty(env, layerObject, "filename", value) || !getString(env, value, layer.filename)
+            || !getNumber(env, layerObject, "weight", weight))
+        {
+            return throwError(env, "Each layer needs a filename and a weight");
+        }
+        layer.weight = (float)weight;
+        layer.expression = "value";
+        if (getProperty(env, layerObject, "expression", value) && !getString(env, value, layer.expression))
+        {
+            return throwError(env, "A layer's expression must be a string");
+        }
+        work->layers.push_back(std::move(layer));
+    }
+
+    if (!borrowRaster(env, argv[0], work->elevation))
+    {
+        return throwError(env, "buildCostRaster expects an elevation raster");
+    }
+    return queue(env, std::move(work), "breadcrumbs.buildCostRaster");
+}
+
+/*
+ * The object behind a handle from createProgress. SearchProgress takes one search at a time,
+ * so a route marks the handle as routing until its work completes. Only the main thread
+ * reads or writes the mark.
+ */
+struct ProgressHandle
+{
+    ProgressHandle(long interval, long frontierScale)
+        : progress(interval, frontierScale)
+    {}
+
+    SearchProgress progress;
+    bool routing = false;
+};
+
+struct RouteWork : Work
+{
+    BorrowedRaster elevation;
+    BorrowedRaster cost;
+    deque<MatrixPoint> points;
+    Weights weights = {};
+    // The channel the search reports to, held alive by progressReference until the work completes
+    ProgressHandle *progress = nullptr;
+    napi_ref progressReference = nullptr;
+    // The token which can stop the search, held alive likewise
+    const CancellationToken *cancellation = nullptr;
+    napi_ref cancellationReference = nullptr;
+    Route route;
+    SearchStats stats;
+    double routeCost = 0;
+
+    void run() override
+    {
+        const RasterView elevationView(elevation.cells, elevation.width, elevation.height);
+        // Without a cost raster every cell costs nothing extra
+        vector<float> noCost;
+        if (!cost.cells)
+        {
+            noCost.assign(elevation.width * elevation.height, 0.0f);
+        }
+        const RasterView costView(cost.cells ? cost.cells : noCost.data(), elevation.width, elevation.height);
+
+        route = getShortestPath(elevationView, costView, points, weights, progress ? &progress->progress : nullptr,
+                                cancellation, &stats);
+        if (stats.status == SearchStatus::Complete)
+        {
+            routeCost = getRouteCost(elevationView, costView, route, weights);
+        }
+    }
+
+    void releaseInputs(napi_env env) override
+    {
+        release(env, elevation);
+        release(env, cost);
+        if (progressReference)
+        {
+            progress->routing = false;
+            napi_delete_reference(env, progressReference);
+        }
+        if (cancellationReference)
+        {
+            napi_delete_reference(env, cancellationReference);
+        }
+    }
+
+    napi_value settle(napi_env env) override
+    {
+        if (stats.status != SearchStatus::Complete)
+        {
+            return rejectStopped(env);
+        }
+
+        napi_value legs, result, number;
+        napi_create_array_with_length(env, route.size(), &legs);
+        for (size_t i = 0; i < route.size(); ++i)
+        {
+            napi_set_element(env, legs, i, legArray(env, route[i]));
+        }
+
+        napi_create_object(env, &result);
+        napi_set_named_property(env, result, "legs", legs);
+        napi_create_double(env, routeCost, &number);
+        napi_set_named_property(env, result, "cost", number);
+        return result;
+    }
+
+    // Rejects with an error saying why the search stopped, and how far it got
+    napi_value rejectStopped(napi_env env)
+    {
+        const string message = stats.status == SearchStatus::TimedOut ? "Search timed out" : "Search cancelled";
+        napi_value text, error, value;
+        napi_create_string_utf8(env, message.c_str(), message.size(), &text);
+        napi_create_error(env, nullptr, text, &error);
+        napi_create_string_utf8(env, searchStatusName(stats.status), NAPI_AUTO_LENGTH, &value);
+        napi_set_named_property(env, error, "status", value);
+        napi_create_int64(env, stats.expanded, &value);
+        napi_set_named_property(env, error, "expanded", value);
+        napi_create_int64(env, stats.legs, &value);
+        napi_set_named_property(env, error, "legs", value);
+        napi_reject_deferred(env, deferred, error);
+        return nullptr;
+    }
+};
+
+// Reads weights in the form of params.json
+bool getWeights(napi_env env, napi_value object, Weights &weights)
+{
+    napi_value grade, movement, heuristic;
+    double gradeBase, gradeRadius;
+    if (!getNumber(env, object, "unitsPerPixel", weights.unitsPerPixel)
+        || !getProperty(env, object, "grade", grade) || !getNumber(env, grade, "base", gradeBase)
+        || !getNumber(env, grade, "radius", gradeRadius)
+        || !getProperty(env, object, "movementCost", movement)
+        || !getNumber(env, movement, "xy", weights.movementCostXY) || !getNumber(env, movement, "z", weights.movementCostZ)
+        || !getProperty(env, object, "heuristic", heuristic)
+        || !getNumber(env, heuristic, "xy", weights.heuristicXY) || !getNumber(env, heuristic, "z", weights.heuristicZ))
+    {
+        return false;
+    }
+    weights.gradeBase = (int)gradeBase;
+    weights.gradeRadius = (int)gradeRadius;
+    return true;
+}
+
+// Mark the handles made by createProgress and createCancellation, so neither can be passed as the other
+const napi_type_tag progressTag = {0x8f3c2a51d6e04b17ull, 0x9a61c0e2f47d3b58ull};
+const napi_type_tag cancellationTag = {0x2d7e91b4c05a6f83ull, 0xe4b8036a1f92c7d5ull};
+
+/*
+ * Wraps an object in a handle which owns it, deleting it once JavaScript lets go of the handle.
+ * Handles are plain objects rather than externals, as runtimes before Node 20 cannot tag externals.
+ */
+template <typename Held>
+napi_value createHandle(napi_env env, Held *held, const napi_type_tag &tag)
+{
+    napi_value handle;
+    napi_create_object(env, &handle);
+    napi_wrap(env, handle, held, [](napi_env, void *data, void *) { delete static_cast<Held *>(data); },
+              nullptr, nullptr);
+    napi_type_tag_object(env, handle, &tag);
+    return handle;
+}
+
+// The object behind a handle made with the given tag, or null if value is not one
+template <typename Held>
+Held *unwrapHandle(napi_env env, napi_value value, const napi_type_tag &tag)
+{
+    napi_valuetype type;
+    bool tagged = false;
+    void *held = nullptr;
+    if (napi_typeof(env, value, &type) != napi_ok || type != napi_object
+        || napi_check_object_type_tag(env, value, &tag, &tagged) != napi_ok || !tagged
+        || napi_unwrap(env, value, &held) != napi_ok)
+    {
+        return nullptr;
+    }
+    return static_cast<Held *>(held);
+}
+
+// Whether an optional argument was left out, or given as null or undefined
+bool omitted(napi_env env, size_t argc, napi_value *argv, size_t index)
+{
+    napi_valuetype type;
+    return argc <= index || napi_typeof(env, argv[index], &type) != napi_ok
+           || type == napi_null || type == napi_undefined;
+}
+
+/*
+ * createProgress(interval, frontierScale) returns a handle for watching one route search at a
+ * time. The search reports every interval expansions, and with a frontierScale above 0 also
+ * marks which blocks of that many cells square hold cells waiting to be expanded.
+ */
+napi_value createProgress(napi_env env, napi_callback_info info)
+{
+    size_t argc = 2;
+    napi_value argv[2];
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+
+    int64_t interval = 65536, frontierScale = 0;
+    if ((argc > 0 && napi_get_value_int64(env, argv[0], &interval) != napi_ok)
+        || (argc > 1 && napi_get_value_int64(env, argv[1], &frontierScale) != napi_ok))
+    {
+        return throwError(env, "createProgress expects an interval and a frontier scale");
+    }
+
+    return createHandle(env, new ProgressHandle((long)interval, (long)frontierScale), progressTag);
+}
+
+/*
+ * readProgress(handle) returns the newest snapshot since the last read, or null if there is none:
+ * {leg, expanded, path, finished}, with path an Int32Array of x, y pairs from the leg's start to
+ * the cell last expanded, and frontier {width, height, cells} with cells a Uint8Array when asked for.
+ */
+napi_value readProgress(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value argv[1];
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+
+    ProgressHandle *handle = argc > 0 ? unwrapHandle<ProgressHandle>(env, argv[0], progressTag) : nullptr;
+    if (!handle)
+    {
+        return throwError(env, "readProgress expects a handle from createProgress");
+    }
+    SearchProgress *progress = &handle->progress;
+
+    napi_value result;
+    SearchSnapshot snapshot;
+    if (!progress->read(snapshot))
+    {
+        napi_get_null(env, &result);
+        return result;
+    }
+
+    napi_value number, flag;
+    napi_create_object(env, &result);
+    napi_create_int64(env, snapshot.leg, &number);
+    napi_set_named_property(env, result, "leg", number);
+    napi_create_int64(env, snapshot.expanded, &number);
+    napi_set_named_property(env, result, "expanded", number);
+    napi_set_named_property(env, result, "path", legArray(env, snapshot.bestPath));
+    napi_get_boolean(env, snapshot.finished, &flag);
+    napi_set_named_property(env, result, "finished", flag);
+
+    if (!snapshot.frontier.empty())
+    {
+        const size_t length = snapshot.frontier.size();
+        napi_value frontier, cells;
+        napi_create_typedarray(env, napi_uint8_array, length,
+                               handOver(env, std::make_unique<vector<uint8_t>>(std::move(snapshot.frontier))), 0, &cells);
+        napi_create_object(env, &frontier);
+        napi_create_int64(env, snapshot.frontierWidth, &number);
+        napi_set_named_property(env, frontier, "width", number);
+        napi_create_int64(env, snapshot.frontierHeight, &number);
+        napi_set_named_property(env, frontier, "height", number);
+        napi_set_named_property(env, frontier, "cells", cells);
+        napi_set_named_property(env, result, "frontier", frontier);
+    }
+    return result;
+}
+
+/*
+ * createCancellation(timeout) returns a handle which stops the searches given it once it is
+ * cancelled, or once timeout milliseconds have passed if a timeout above 0 is given.
+ */
+napi_value createCancellation(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value argv[1];
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+
+    double timeout = 0;
+    if (!omitted(env, argc, argv, 0) && napi_get_value_double(env, argv[0], &timeout) != napi_ok)
+    {
+        return throwError(env, "createCancellation expects a timeout in milliseconds");
+    }
+
+    return createHandle(env, new CancellationToken(CancellationToken::deadlineAfter(timeout)), cancellationTag);
+}
+
+// cancel(handle) stops every search given the handle, which then reject
+napi_value cancel(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value argv[1];
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+
+    CancellationToken *cancellation = argc > 0 ? unwrapHandle<CancellationToken>(env, argv[0], cancellationTag)
+                                               : nullptr;
+    if (!cancellation)
+    {
+        return throwError(env, "cancel expects a handle from createCancellation");
+    }
+    cancellation->cancel();
+
+    napi_value undefined;
+    napi_get_undefined(env, &undefined);
+    return undefined;
+}
+
+/*
+ * route(elevation, cost, points, weights, progress, cancellation) resolves to {legs, cost}: one
+ * Int32Array per leg holding its cells as x, y pairs, and the route's total cost. cost may be null
+ * for no cost layers, points is a list of {x, y}, and weights take the form of params.json.
+ * progress is an optional handle from createProgress, which only one search may report to at a time;
+ * passing one to route while an earlier route still holds it throws.
+ * cancellation is an optional handle from createCancellation; a search it stops rejects with an
+ * error whose status is "cancelled" or "timedOut", with the cells expanded and legs completed.
+ */
+napi_value route(napi_env env, napi_callback_info info)
+{
+    size_t argc = 6;
+    napi_value argv[6];
+    napi_get_cb_info(env, info, &argc, argv, nullptr, nullptr);
+    if (argc < 4)
+    {
+        return throwError(env, "route expects elevation, cost, points and weights");
+    }
+
+    auto work = std::make_unique<RouteWork>();
+    if (!getWeights(env, argv[3], work->weights))
+    {
+        return throwError(env, "Weights need unitsPerPixel, grade, movementCost and heuristic");
+    }
+
+    BorrowedRaster elevation;
+    if (!borrowRaster(env, argv[0], elevation))
+    {
+        return throwError(env, "route expects an elevation raster");
+    }
+
+    bool isArray = false;
+    uint32_t count = 0;
+    napi_is_array(env, argv[2], &isArray);
+    if (isArray)
+    {
+        napi_get_array_length(env, argv[2], &count);
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        napi_value pointObject;
+        napi_get_element(env, argv[2], i, &pointObject);
+        double x, y;
+        // NaN would pass the range check, so it is ruled out first
+        if (!getNumber(env, pointObject, "x", x) || !getNumber(env, pointObject, "y", y)
+            || !std::isfinite(x) || !std::isfinite(y)
+            || x < 0 || y < 0 || x >= elevation.width || y >= elevation.height)
+        {
+            release(env, elevation);
+            return throwError(env, "Each point needs an x and y inside the raster");
+        }
+        MatrixPoint point;
+        point.x = (long)x;
+        point.y = (long)y;
+        work->points.push_back(point);
+    }
+    if (work->points.size() < 2)
+    {
+        release(env, elevation);
+        return throwError(env, "A route needs at least two points");
+    }
+
+    napi_valuetype costType;
+    napi_typeof(env, argv[1], &costType);
+    if (costType != napi_null && costType != napi_undefined)
+    {
+        BorrowedRaster cost;
+        if (!borrowRaster(env, argv[1], cost) || cost.width != elevation.width || cost.height != elevation.height)
+        {
+            release(env, elevation);
+            release(env, cost);
+            return throwError(env, "The cost raster must be the same size as the elevation");
+        }
+        work->cost = cost;
+    }
+
+    if (!omitted(env, argc, argv, 4))
+    {
+        work->progress = unwrapHandle<ProgressHandle>(env, argv[4], progressTag);
+        if (!work->progress || work->progress->routing)
+        {
+            release(env, elevation);
+            release(env, work->cost);
+            return throwError(env, work->progress ? "The progress handle is already watching another route"
+                                                  : "route expects a progress handle from createProgress");
+        }
+        work->progress->routing = true;
+        napi_create_reference(env, argv[4], 1, &work->progressReference);
+    }
+    if (!omitted(env, argc, argv, 5))
+    {
+        work->cancellation = unwrapHandle<CancellationToken>(env, argv[5], cancellationTag);
+        if (!work->cancellation)
+        {
+            release(env, elevation);
+            release(env, work->cost);
+            if (work->progressReference)
+            {
+                work->progress->routing = false;
+                napi_delete_reference(env, work->progressReference);
+            }
+            return throwError(env, "route expects a cancellation handle from createCancellation");
+        }
+        napi_create_reference(env, argv[5], 1, &work->cancellationReference);
+    }
+
+    work->elevation = elevation;
+    return queue(env, std::move(work), "breadcrumbs.route");
+}
+
+napi_value init(napi_env env, napi_value exports)
+{
+    const napi_property_descriptor functions [] = {
+            {"readRaster", nullptr, readRaster, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"buildCostRaster", nullptr, buildCostRaster, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"createProgress", nullptr, createProgress, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"createCancellation", nullptr, createCancellation, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"cancel", nullptr, cancel, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"readProgress", nullptr, readProgress, nullptr, nullptr, nullptr, napi_default, nullptr},
+            {"route", nullptr, route, nullptr, nullptr, nullptr, napi_default, nullptr}
+    };
+    napi_define_properties(env, exports, sizeof(functions) / sizeof(functions[0]), functions);
+    return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
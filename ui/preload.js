@@ -1,5 +1,9 @@
 const { contextBridge, ipcRenderer } = require('electron')
 
 contextBridge.exposeInMainWorld("api", {
-  generateRoute: formData => ipcRenderer.send('generateRoute', formData)
+  generateRoute: params => ipcRenderer.send('generateRoute', params),
+  cancelRoute: () => ipcRenderer.send('cancelRoute'),
+  onRouteProgress: callback => ipcRenderer.on('routeProgress', (event, snapshot) => callback(snapshot)),
+  onRouteGenerated: callback => ipcRenderer.on('routeGenerated', (event, route) => callback(route)),
+  onRouteFailed: callback => ipcRenderer.on('routeFailed', (event, message) => callback(message))
 })
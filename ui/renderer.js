@@ -1,9 +1,41 @@
+// FormData cannot be sent to the main process, so the form is read into params.json's shape
+function formParams(formElement) {
+  let data = new FormData(formElement)
+  let number = name => Number(data.get(name))
+  let xs = data.getAll("x")
+  let ys = data.getAll("y")
+
+  return {
+    elevation: data.get("elevation").path,
+    points: xs.map((x, i) => ({ x: Number(x), y: Number(ys[i]) })),
+    weights: {
+      unitsPerPixel: number("units-per-pixel"),
+      grade: { base: number("grade-weight"), radius: number("grade-distance") },
+      movementCost: { xy: number("movement-weight-horizontal"), z: number("movement-weight-vertical") },
+      heuristic: { xy: number("heuristic-horizontal"), z: number("heuristic-vertical") }
+    }
+  }
+}
+
 function submitParams(event, formElement) {
   event.preventDefault()
 
-  let data = new FormData(formElement)
-  window.api.generateRoute(data)
+  window.api.generateRoute(formParams(formElement))
 }
 
 let form = document.getElementById("parameters-form")
 form.addEventListener("submit", event => submitParams(event, form))
+
+document.getElementById("cancel-route").addEventListener("click", () => window.api.cancelRoute())
+
+let result = document.getElementById("route-result")
+window.api.onRouteProgress(snapshot => {
+  result.textContent = `Searching leg ${snapshot.leg + 1}: ${snapshot.expanded} cells expanded, best path ${snapshot.path.length / 2} cells`
+})
+window.api.onRouteGenerated(route => {
+  let cells = route.legs.reduce((total, leg) => total + leg.length / 2, 0)
+  result.textContent = `Route of ${cells} cells in ${route.legs.length} legs, cost ${route.cost.toFixed(1)}`
+})
+window.api.onRouteFailed(message => {
+  result.textContent = `Routing failed: ${message}`
+})